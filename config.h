@@ -20,7 +20,9 @@
 #include <windows.h>
 #else
 #include <unistd.h>
+#include <signal.h>
 #include <sys/time.h>
+#include <sys/wait.h>
 #endif
 
 #include <string>
@@ -46,6 +48,8 @@ static const char ST_ITR_CLOSE[] = "iterator_close";
 typedef struct {
     std::string name;
     std::vector<uint64_t> latencies;
+    size_t summed = 0;      // latencies[0, summed) are folded into sum
+    double sum = 0;
 } stat_history_t;
 
 struct reader_context {
@@ -54,8 +58,57 @@ struct reader_context {
     stat_history_t *stat_itr_get;
     stat_history_t *stat_itr_next;
     stat_history_t *stat_itr_close;
+    stat_history_t *stat_get;
 };
 
+// benchmark scenarios selectable on the command line
+enum {
+    SCENARIO_ITERATOR     = 0x0001,
+    SCENARIO_RECOVERY     = 0x0002,
+    SCENARIO_REPLAY       = 0x0004,
+    SCENARIO_MATRIX       = 0x0008,
+    SCENARIO_BGFLUSH      = 0x0010,
+    SCENARIO_GROUP_COMMIT = 0x0020,
+    SCENARIO_KVS_SCALING  = 0x0040,
+    SCENARIO_LOOKUP       = 0x0080,
+    SCENARIO_AGING        = 0x0100,
+    SCENARIO_ROLLBACK     = 0x0200,
+    SCENARIO_CODEC        = 0x0400,
+    SCENARIO_MULTIPROC    = 0x0800,
+};
+
+// named configuration run by the config matrix
+typedef struct {
+    const char *name;
+    fdb_config fconfig;
+    fdb_kvs_config kvs_config;
+} bench_profile_t;
+
+// command line tunables, see usage() in fdb_bench.cc
+typedef struct {
+    uint32_t scenarios;     // SCENARIO_* bits to run
+    int n_loops;            // measured loops (minimum when converging)
+    int max_loops;          // cap on warmup loops and on measured loops
+    uint64_t warmup_ops;    // discard loops until this many ops are tracked
+    uint64_t warmup_ms;     // discard loops until this much time has elapsed
+    double steady_cv;       // end warmup once per-loop medians have a
+                            // rolling coefficient of variation below this
+    int steady_window;      // number of loops in the rolling cv window
+    double converge_tol;    // extend the run until p50/p95/p99 move less
+                            // than this fraction between measured loops
+    const char *record_path; // write a trace of the run here
+    const char *replay_path; // trace replayed by the replay scenario
+    int replay_threads;     // replay threads, files split between them
+    double replay_speed;    // 0 = as fast as possible, else a multiple
+                            // of the recorded rate
+    const char *profiles;   // comma separated config matrix profiles,
+                            // NULL = all, or only --profile ones if any
+    std::vector<bench_profile_t> custom_profiles; // defined by --profile
+    int aging_cycles;       // dataset overwrite cycles of the aging run
+    int mp_procs;           // worker processes of the multiproc run
+    bool attribution;       // per-phase client vs engine latency report
+} bench_opts_t;
+
 #define alca(type, n) ((type*)alloca(sizeof(type) * (n)))
 
 
@@ -18,16 +18,26 @@
 
 #include <stdio.h>
 #include <assert.h>
+#if !defined(WIN32) && !defined(_WIN32)
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#endif
 
 #include <algorithm>
+#include <atomic>
 #include <cmath>
 #include <iterator>
+#include <limits>
 #include <numeric>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "config.h"
 #include "timing.h"
+#include "trace.h"
 
 #include <libforestdb/forestdb.h>
 
@@ -40,9 +50,74 @@ struct Stats {
     double pct5;
     double pct95;
     double pct99;
-    std::vector<T>* values;
+    size_t count;
+    int stat;                           // index in StatCollector::t_stats
+    std::vector<size_t> histogram;
 };
 
+// Running mean and variance (Welford); partial results from independent
+// sources combine with merge() (Chan et al.).
+struct RunningStat {
+    RunningStat() : n(0), mean(0), m2(0) { }
+
+    void add(double x) {
+        double delta = x - mean;
+        mean += delta / ++n;
+        m2 += delta * (x - mean);
+    }
+
+    void merge(const RunningStat& o) {
+        if (o.n == 0) {
+            return;
+        }
+        double delta = o.mean - mean;
+        uint64_t total = n + o.n;
+        mean += delta * o.n / total;
+        m2 += o.m2 + delta * delta * ((double)n * o.n / total);
+        n = total;
+    }
+
+    double stddev() const {
+        return n > 1 ? sqrt(m2 / (n - 1)) : 0;
+    }
+
+    uint64_t n;
+    double mean;
+    double m2;
+};
+
+// Print c spaces times and end the line, used for table rules.
+void fillLineWith(const char c, int spaces) {
+
+    for (int i = 0; i < spaces; ++i) {
+        putchar(c);
+    }
+    putchar('\n');
+}
+
+// Run fn(k) for every k in [0, n) on up to one thread per cpu.
+template<typename F>
+void parallel_for(size_t n, F fn) {
+
+    std::atomic<size_t> next(0);
+    size_t n_workers = std::min<size_t>(n,
+                            std::max(1u, std::thread::hardware_concurrency()));
+    auto worker = [&]() {
+        size_t k;
+        while ((k = next++) < n) {
+            fn(k);
+        }
+    };
+    std::vector<std::thread> workers;
+    for (size_t w = 1; w < n_workers; ++w) {
+        workers.push_back(std::thread(worker));
+    }
+    worker();
+    for (auto& t : workers) {
+        t.join();
+    }
+}
+
 class StatCollector {
 public:
     StatCollector(int _num_stats, int _num_samples) {
@@ -65,72 +140,251 @@ public:
 
     void aggregateAndPrintAll(const char* title, int count, const char* unit) {
 
-        std::vector<std::pair<std::string, std::vector<uint64_t>*> > all_timings;
-        for (int i = 0; i < num_stats; ++i) {
-            for (int j = 1; j < num_samples; ++j) {
-                t_stats[i][0].latencies.insert(t_stats[i][0].latencies.end(),
-                                                   t_stats[i][j].latencies.begin(),
-                                                   t_stats[i][j].latencies.end());
-                t_stats[i][j].latencies.clear();
-            }
-
-            all_timings.push_back(std::make_pair(t_stats[i][0].name,
-                                                 &t_stats[i][0].latencies));
-        }
+        std::vector<Stats<uint64_t> > all_stats = summarize();
 
         int printed = 0;
         printf("\n========== Avg Latencies (%s) - %d samples (%s) %n",
                 title, count, unit, &printed);
         fillLineWith('=', 88-printed);
 
-        print_values(all_timings, unit);
+        print_values(all_stats, unit);
 
         fillLineWith('=', 87);
     }
 
+    // Summary of every stat across all of its sources, empty ones left
+    // out unless keep_empty (then entry i is stat i). Samples are split
+    // into chunks that are copied into per-stat scratch vectors and
+    // streamed through RunningStat in parallel, whatever the number of
+    // stats or sources; percentiles are then selected per stat, also in
+    // parallel. The samples are neither reordered nor cleared.
+    std::vector<Stats<uint64_t> > summarize(bool keep_empty = false) {
+
+        std::vector<Stats<uint64_t> > all_stats(num_stats);
+        std::vector<std::vector<uint64_t> > scratch(num_stats);
+        std::vector<sample_chunk> chunks = make_chunks();
+        std::vector<RunningStat> parts(chunks.size());
+
+        for (int i = 0; i < num_stats; ++i) {
+            scratch[i].resize(count(i));
+        }
+        parallel_for(chunks.size(), [&](size_t k) {
+            const sample_chunk& ch = chunks[k];
+            std::copy(ch.src, ch.src + ch.len,
+                      scratch[ch.stat].begin() + ch.offset);
+            for (size_t n = 0; n < ch.len; ++n) {
+                parts[k].add(ch.src[n]);
+            }
+        });
+
+        std::vector<RunningStat> running(num_stats);
+        for (size_t k = 0; k < chunks.size(); ++k) {
+            running[chunks[k].stat].merge(parts[k]);
+        }
+        parallel_for(num_stats, [&](size_t i) {
+            select_stat(i, scratch[i], running[i], &all_stats[i]);
+            std::vector<uint64_t>().swap(scratch[i]);
+        });
+
+        if (!keep_empty) {
+            all_stats.erase(std::remove_if(all_stats.begin(),
+                                           all_stats.end(),
+                                           [](const Stats<uint64_t>& st) {
+                                               return st.count == 0;
+                                           }),
+                            all_stats.end());
+        }
+        return all_stats;
+    }
+
+    int numStats() {
+        return num_stats;
+    }
+
+    int numSamples() {
+        return num_samples;
+    }
+
+    // Number of samples held for stat i across all sources.
+    size_t count(int i) {
+
+        size_t n = 0;
+        for (int j = 0; j < num_samples; ++j) {
+            n += t_stats[i][j].latencies.size();
+        }
+        return n;
+    }
+
+    // pct-th percentile of stat i across all sources, leaving the
+    // samples themselves untouched.
+    double percentile(int i, int pct) {
+
+        std::vector<uint64_t> vec;
+        vec.reserve(count(i));
+        for (int j = 0; j < num_samples; ++j) {
+            vec.insert(vec.end(), t_stats[i][j].latencies.begin(),
+                                  t_stats[i][j].latencies.end());
+        }
+        if (vec.size() == 0) {
+            return 0;
+        }
+
+        auto nth = vec.begin() + (vec.size() * pct) / 100;
+        std::nth_element(vec.begin(), nth, vec.end());
+        return *nth;
+    }
+
+    // Sum of the samples held for stat i across all sources. Samples are
+    // only ever appended (moveSamplesTo resets the source), so each call
+    // only adds what arrived since the last one.
+    double sum(int i) {
+
+        double total = 0;
+        for (int j = 0; j < num_samples; ++j) {
+            stat_history_t& h = t_stats[i][j];
+            if (h.summed > h.latencies.size()) {
+                h.summed = 0;
+                h.sum = 0;
+            }
+            h.sum = std::accumulate(h.latencies.begin() + h.summed,
+                                    h.latencies.end(), h.sum);
+            h.summed = h.latencies.size();
+            total += h.sum;
+        }
+        return total;
+    }
+
+    // Append every sample to the same slot of dst (which must have the
+    // same shape) and clear them here.
+    void moveSamplesTo(StatCollector *dst) {
+
+        for (int i = 0; i < num_stats; ++i) {
+            for (int j = 0; j < num_samples; ++j) {
+                std::vector<uint64_t>& src = t_stats[i][j].latencies;
+                dst->t_stats[i][j].name = t_stats[i][j].name;
+                dst->t_stats[i][j].latencies.insert(
+                                    dst->t_stats[i][j].latencies.end(),
+                                    src.begin(), src.end());
+                src.clear();
+                t_stats[i][j].summed = 0;
+                t_stats[i][j].sum = 0;
+            }
+        }
+    }
+
     stat_history_t** t_stats;
 
 private:
 
-    // Given a vector of values (each a vector<T>) calcuate metrics on them
-    // and print to stdout.
-    template<typename T>
-    void print_values(
-                std::vector<std::pair<std::string, std::vector<T>*> > values,
-                std::string unit) {
-
-        // First, calculate mean, median, standard deviation and percentiles
-        // of each set of values, both for printing and to derive what the
-        // range of the graphs should be.
-        std::vector<Stats<T> > value_stats;
-        for (const auto& t : values) {
-            Stats<T> stats;
-            if (t.second->size() == 0) {
-                continue;
+    // Contiguous slice of one source of one stat and where it lands in
+    // that stat's scratch vector.
+    struct sample_chunk {
+        int stat;
+        const uint64_t *src;
+        size_t len;
+        size_t offset;
+    };
+
+    // Cut every source into slices of at most chunk_len samples, so even
+    // a single large source is spread over all workers.
+    std::vector<sample_chunk> make_chunks() {
+
+        const size_t chunk_len = 1 << 16;
+        std::vector<sample_chunk> chunks;
+        for (int i = 0; i < num_stats; ++i) {
+            size_t offset = 0;
+            for (int j = 0; j < num_samples; ++j) {
+                const std::vector<uint64_t>& src = t_stats[i][j].latencies;
+                for (size_t b = 0; b < src.size(); b += chunk_len) {
+                    sample_chunk ch;
+                    ch.stat = i;
+                    ch.src = src.data() + b;
+                    ch.len = std::min(chunk_len, src.size() - b);
+                    ch.offset = offset;
+                    chunks.push_back(ch);
+                    offset += ch.len;
+                }
             }
-            stats.name = t.first;
-            stats.values = t.second;
-            std::vector<T>& vec = *t.second;
+        }
+        return chunks;
+    }
 
-            // Calculate latency percentiles
-            std::sort(vec.begin(), vec.end());
-            stats.median = vec[(vec.size() * 50) / 100];
-            stats.pct5 = vec[(vec.size() * 5) / 100];
-            stats.pct95 = vec[(vec.size() * 95) / 100];
-            stats.pct99 = vec[(vec.size() * 99) / 100];
+    // Fill in st from the merged samples of stat i. Percentiles are found
+    // by successive selection on vec rather than a full sort.
+    void select_stat(int i, std::vector<uint64_t>& vec,
+                     const RunningStat& running, Stats<uint64_t> *st) {
+
+        st->name = t_stats[i][0].name;
+        st->stat = i;
+        st->count = vec.size();
+        st->mean = st->stddev = 0;
+        st->median = st->pct5 = st->pct95 = st->pct99 = 0;
+        if (vec.empty()) {
+            return;
+        }
 
-            const double sum = std::accumulate(vec.begin(), vec.end(), 0.0);
-            stats.mean = sum / vec.size();
-            double accum = 0.0;
-            for (auto &d : vec) {
-                accum += (d - stats.mean) * (d - stats.mean);
+        // each selection partitions vec around its pivot, so later ones
+        // only search the side of an earlier pivot they can lie in
+        typedef std::vector<uint64_t>::iterator iter;
+        auto at = [&vec](int pct) {
+            return vec.begin() + (vec.size() * pct) / 100;
+        };
+        auto select = [&at](iter lo, int pct, iter hi) {
+            iter nth = at(pct);
+            if (nth >= lo && nth < hi) {
+                std::nth_element(lo, nth, hi);
             }
-            stats.stddev = sqrt(accum / (vec.size() - 1));
+            return *nth;
+        };
+        st->median = select(vec.begin(), 50, vec.end());
+        st->pct5 = select(vec.begin(), 5, at(50));
+        st->pct95 = select(at(50) + 1, 95, vec.end());
+        st->pct99 = select(at(95) + 1, 99, vec.end());
+        st->mean = running.mean;
+        st->stddev = running.stddev();
+    }
 
-            value_stats.push_back(stats);
+    // Bin the samples of every stat, one chunk per task. Bin b counts
+    // samples in [(b-1) * width, b * width), width = spark_end / nbins;
+    // bin 0 and anything past the last bin are left out.
+    template<typename T>
+    void fill_histograms(std::vector<Stats<T> >& value_stats, T spark_end,
+                         int nbins) {
+
+        const T width = spark_end / nbins;
+        std::vector<sample_chunk> chunks = make_chunks();
+        std::vector<std::vector<size_t> > parts(chunks.size());
+
+        if (width > 0) {
+            parallel_for(chunks.size(), [&](size_t k) {
+                parts[k].assign(nbins, 0);
+                for (size_t n = 0; n < chunks[k].len; ++n) {
+                    const T bin = chunks[k].src[n] / width + 1;
+                    if (bin < (T)nbins) {
+                        parts[k][bin]++;
+                    }
+                }
+            });
+        }
+        for (auto& stats : value_stats) {
+            stats.histogram.assign(nbins, 0);
+            for (size_t k = 0; k < chunks.size(); ++k) {
+                if (chunks[k].stat != stats.stat || parts[k].empty()) {
+                    continue;
+                }
+                for (int b = 0; b < nbins; ++b) {
+                    stats.histogram[b] += parts[k][b];
+                }
+            }
         }
+    }
+
+    // Given per-stat summaries, print their metrics and a sparkline of
+    // the underlying samples to stdout.
+    template<typename T>
+    void print_values(std::vector<Stats<T> > value_stats, std::string unit) {
 
-        // From these find the start and end for the spark graphs which covers the
+        // Find the start and end for the spark graphs which covers the
         // a "reasonable sample" of each value set. We define that as from the 5th
         // to the 95th percentile, so we ensure *all* sets have that range covered.
         T spark_start = std::numeric_limits<T>::max();
@@ -140,6 +394,9 @@ private:
             spark_end = (stats.pct95 > spark_end) ? stats.pct95 : spark_end;
         }
 
+        const int nbins = 32;
+        fill_histograms(value_stats, spark_end, nbins);
+
         printf("\n                                Percentile\n");
         printf("  %-16s Median     95th     99th  Std Dev  "
                "Histogram of samples\n\n", "");
@@ -159,20 +416,8 @@ private:
                         stats.pct99/1e6, stats.stddev/1e6);
             }
 
-            // Calculate and render Sparkline (requires UTF-8 terminal).
-            const int nbins = 32;
-            int prev_distance = 0;
-            std::vector<size_t> histogram;
-            for (unsigned int bin = 0; bin < nbins; bin++) {
-                const T max_for_bin = (spark_end / nbins) * bin;
-                auto it = std::lower_bound(stats.values->begin(),
-                                           stats.values->end(),
-                                           max_for_bin);
-                const int distance = std::distance(stats.values->begin(), it);
-                histogram.push_back(distance - prev_distance);
-                prev_distance = distance;
-            }
-
+            // Render Sparkline (requires UTF-8 terminal).
+            const std::vector<size_t>& histogram = stats.histogram;
             const auto minmax = std::minmax_element(histogram.begin(),
                                                     histogram.end());
             const size_t range = *minmax.second - *minmax.first + 1;
@@ -197,18 +442,151 @@ private:
         }
     }
 
-    void fillLineWith(const char c, int spaces) {
+    int num_stats;
+    int num_samples;
+};
+
+/*
+ * Decides, one loop at a time, when the cold start of a benchmark is over.
+ * While warming up, each finished loop's samples are moved out of the
+ * measured collector into a separate warmup collector so they never reach
+ * the reported percentiles.
+ */
+class WarmupTracker {
+public:
+    WarmupTracker(const bench_opts_t *_opts, StatCollector *_sa,
+                  StatCollector *_warm_sa)
+        : opts(_opts), sa(_sa), warm_sa(_warm_sa), loops(0), ops(0),
+          medians(_sa->numStats()) {
+
+        warming = opts->warmup_ops > 0 || opts->warmup_ms > 0 ||
+                  opts->steady_cv > 0;
+        start = get_monotonic_ts();
+    }
+
+    bool inWarmup() {
+        return warming;
+    }
+
+    int warmupLoops() {
+        return loops;
+    }
+
+    uint64_t warmupOps() {
+        return ops;
+    }
+
+    // Called after every loop while inWarmup(); returns true once the
+    // warmup criteria are met and the next loop should be measured.
+    bool loopDone() {
 
-        for (int i = 0; i < spaces; ++i) {
-            putchar(c);
+        loops++;
+        for (const auto& st : sa->summarize(true)) {
+            if (st.count > 0) {
+                medians[st.stat].push_back(st.median);
+            }
+            ops += st.count;
         }
-        putchar('\n');
+        sa->moveSamplesTo(warm_sa);
+
+        uint64_t elapsed_ms = ts_diff(start, get_monotonic_ts()) / 1000;
+        bool ops_short = ops < opts->warmup_ops;
+        bool time_short = elapsed_ms < opts->warmup_ms;
+        bool unsteady = opts->steady_cv > 0 && !isSteady();
+        if (ops_short || time_short || unsteady) {
+            if (loops < opts->max_loops) {
+                return false;
+            }
+            // name every criterion that max_loops cut short
+            char unmet[256];
+            int len = 0;
+            if (ops_short) {
+                len += snprintf(unmet + len, sizeof(unmet) - len,
+                                " --warmup-ops (%llu of %llu)",
+                                (unsigned long long)ops,
+                                (unsigned long long)opts->warmup_ops);
+            }
+            if (time_short) {
+                len += snprintf(unmet + len, sizeof(unmet) - len,
+                                " --warmup-ms (%llu of %llu)",
+                                (unsigned long long)elapsed_ms,
+                                (unsigned long long)opts->warmup_ms);
+            }
+            if (unsteady) {
+                snprintf(unmet + len, sizeof(unmet) - len,
+                         " --steady-cv (no steady state)");
+            }
+            printf("  warmup: not met after %d loops, measuring anyway:%s\n",
+                   loops, unmet);
+        }
+        warming = false;
+        return true;
     }
 
-    int num_stats;
-    int num_samples;
+private:
+
+    // Every stat's per-loop median must have a coefficient of variation
+    // at or below steady_cv over the last steady_window loops.
+    bool isSteady() {
+
+        int window = opts->steady_window;
+        for (const auto& m : medians) {
+            if ((int)m.size() < window) {
+                if (m.size() == 0) {
+                    continue;
+                }
+                return false;
+            }
+
+            double mean = std::accumulate(m.end() - window, m.end(), 0.0)
+                          / window;
+            double accum = 0.0;
+            for (auto it = m.end() - window; it != m.end(); ++it) {
+                accum += (*it - mean) * (*it - mean);
+            }
+            double cv = mean > 0 ? sqrt(accum / (window - 1)) / mean : 0;
+            if (cv > opts->steady_cv) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    const bench_opts_t *opts;
+    StatCollector *sa;
+    StatCollector *warm_sa;
+    bool warming;
+    int loops;
+    uint64_t ops;
+    ts_nsec start;
+    std::vector<std::vector<double> > medians;
 };
 
+/*
+ * Compare p50/p95/p99 of every stat in sa against the values recorded by
+ * the previous call (held in prev) and report whether none moved by more
+ * than tol, as a fraction of the previous value.
+ */
+bool percentiles_converged(StatCollector *sa, std::vector<double> &prev,
+                           double tol) {
+
+    const int npcts = 3;        // p50, p95, p99
+    std::vector<double> cur;
+    bool converged = prev.size() > 0;
+
+    for (const auto& st : sa->summarize(true)) {
+        const double vals[] = {st.median, st.pct95, st.pct99};
+        cur.insert(cur.end(), vals, vals + npcts);
+    }
+    for (size_t k = 0; converged && k < cur.size(); ++k) {
+        if (std::fabs(cur[k] - prev[k]) > prev[k] * tol) {
+            converged = false;
+        }
+    }
+    prev.swap(cur);
+    return converged;
+}
+
 bool track_stat(stat_history_t *stat, uint64_t lat) {
 
     if (lat == ERR_NS) {
@@ -273,6 +651,52 @@ void str_gen(char *s, const int len) {
     s[len-1] = '\0';
 }
 
+// value bodies with controllable compressibility
+enum {
+    VALUE_REPEAT,       // str_gen() pattern, compresses extremely well
+    VALUE_TEXT,         // words from a small vocabulary, like json/text
+    VALUE_RANDOM,       // random bytes, incompressible
+    VALUE_NUM_KINDS
+};
+
+static const char *value_kind_names[] = {"repeat", "text", "random"};
+
+// small lcg so value bodies are reproducible on every platform
+static unsigned int value_rand(unsigned int *seed) {
+    *seed = *seed * 1103515245 + 12345;
+    return (*seed >> 16) & 0x7fff;
+}
+
+void value_gen(char *s, const int len, int kind, unsigned int *seed) {
+
+    static const char *words[] = {
+        "the", "key", "value", "document", "couchbase", "forestdb",
+        "\"name\":", "\"id\":", "{", "}", "true", "false", "null",
+        "index", "seqnum", "vbucket", "replica", "commit", "12", "4096"
+    };
+    const int n_words = sizeof(words) / sizeof(words[0]);
+    int i = 0;
+
+    if (kind == VALUE_REPEAT) {
+        str_gen(s, len);
+        return;
+    }
+    while (i < len - 1) {
+        if (kind == VALUE_RANDOM) {
+            s[i++] = (char)(value_rand(seed) & 0xff);
+        } else {
+            const char *w = words[value_rand(seed) % n_words];
+            while (*w && i < len - 1) {
+                s[i++] = *w++;
+            }
+            if (i < len - 1) {
+                s[i++] = ' ';
+            }
+        }
+    }
+    s[len - 1] = '\0';
+}
+
 void swap(char *x, char *y) {
 
     char temp;
@@ -281,7 +705,8 @@ void swap(char *x, char *y) {
     *y = temp;
 }
 
-void permute(fdb_kvs_handle *kv, char *a, int l, int r) {
+void permute(fdb_kvs_handle *kv, char *a, int l, int r,
+             stat_history_t *stat_set) {
 
     int i;
     char keybuf[256], metabuf[256], bodybuf[1024];
@@ -294,18 +719,19 @@ void permute(fdb_kvs_handle *kv, char *a, int l, int r) {
         fdb_doc_create(&doc, (void*)keybuf, strlen(keybuf),
                        (void*)metabuf, strlen(metabuf),
                        (void*)bodybuf, strlen(bodybuf));
-        fdb_set(kv, doc);
+        track_stat(stat_set, timed_fdb_set(kv, doc));
+        trace_record_doc(TRACE_OP_SET, kv, doc);
         fdb_doc_free(doc);
     } else {
         for (i = l; i <= r; i++) {
             swap((a+l), (a+i));
-            permute(kv, a, l+1, r);
+            permute(kv, a, l+1, r, stat_set);
             swap((a+l), (a+i)); //backtrack
         }
     }
 }
 
-void sequential(fdb_kvs_handle *kv, int pos) {
+void sequential(fdb_kvs_handle *kv, int pos, stat_history_t *stat_set) {
 
     int i;
     char keybuf[256], metabuf[256], bodybuf[512];
@@ -319,18 +745,19 @@ void sequential(fdb_kvs_handle *kv, int pos) {
         fdb_doc_create(&doc, (void*)keybuf, strlen(keybuf),
                        (void*)metabuf, strlen(metabuf),
                        (void*)bodybuf, strlen(bodybuf));
-        fdb_set(kv, doc);
+        track_stat(stat_set, timed_fdb_set(kv, doc));
+        trace_record_doc(TRACE_OP_SET, kv, doc);
         fdb_doc_free(doc);
     }
 }
 
-void writer(fdb_kvs_handle *db, int pos) {
+void writer(fdb_kvs_handle *db, int pos, stat_history_t *stat_set) {
 
     char keybuf[KEY_SIZE];
 
     str_gen(keybuf, KEY_SIZE);
-    permute(db, keybuf, 0, PERMUTED_BYTES);
-    sequential(db, pos);
+    permute(db, keybuf, 0, PERMUTED_BYTES, stat_set);
+    sequential(db, pos, stat_set);
 }
 
 void reader(reader_context *ctx) {
@@ -339,7 +766,7 @@ void reader(reader_context *ctx) {
     fdb_kvs_handle *db = ctx->handle;
     fdb_iterator *iterator;
     fdb_doc *doc = NULL, *rdoc = NULL;
-    fdb_status status;
+    ts_nsec lat;
 
     track_stat(ctx->stat_itr_init,
                timed_fdb_iterator_init(db, &iterator, FDB_ITR_NO_DELETES));
@@ -351,8 +778,10 @@ void reader(reader_context *ctx) {
 
         // get from kv
         fdb_doc_create(&doc, rdoc->key, rdoc->keylen, NULL, 0, NULL, 0);
-        status = fdb_get(db, doc);
-        assert(status == FDB_RESULT_SUCCESS);
+        lat = timed_fdb_get(db, doc);
+        assert(lat != ERR_NS);
+        track_stat(ctx->stat_get, lat);
+        trace_record_doc(TRACE_OP_GET, db, doc);
 
         fdb_doc_free(doc);
         doc = NULL;
@@ -365,10 +794,10 @@ void reader(reader_context *ctx) {
                             timed_fdb_iterator_next(iterator));
     } while (!is_err);
     track_stat(ctx->stat_itr_close, timed_fdb_iterator_close(iterator));
-    (void)status;
+    (void)lat;
 }
 
-void deletes(fdb_kvs_handle *db, int pos) {
+void deletes(fdb_kvs_handle *db, int pos, stat_history_t *stat_del) {
 
     int i;
     char keybuf[256];
@@ -378,159 +807,740 @@ void deletes(fdb_kvs_handle *db, int pos) {
     for (i = 0; i < 1000; i++){
         sprintf(keybuf, "%d_%dseqkey", pos, i);
         fdb_doc_create(&doc, (void*)keybuf, strlen(keybuf), NULL, 0, NULL, 0);
-        fdb_del(db, doc);
+        track_stat(stat_del, timed_fdb_delete(db, doc));
+        trace_record_doc(TRACE_OP_DEL, db, doc);
         fdb_doc_free(doc);
     }
 }
 
-void do_bench() {
-
-    int i, j, r;
-    int n_loops = 5;
-    int n_kvs = 16;
+/*
+ * Split between client-measured and engine-measured latency.
+ * begin()/end() bracket a segment of a phase; each takes a snapshot of
+ * the client stat collectors (count and sum of samples) and of the
+ * cumulative fdb_get_latency_stats of every file, and the difference is
+ * added to the phase. forestdb only keeps a truncated running average
+ * per file, which cannot be differenced per phase, so phases get exact
+ * client averages but only engine op counts. Engine averages, overhead
+ * and engine% are reported once for the whole run, between the first
+ * begin() and the last end(), next to the client average over every
+ * phase; lat_max cannot be split and covers the file's whole life.
+ */
+class LatencyAttribution {
+public:
+    LatencyAttribution(bool _enabled, fdb_file_handle **_dbfiles,
+                       int _nfiles)
+        : enabled(_enabled), dbfiles(_dbfiles), nfiles(_nfiles) {
+    }
 
-    char cmd[64], fname[64], dbname[64];
-    int n2_kvs = n_kvs * n_kvs;
+    // client stat collectors to attribute; slot names must be set
+    void addClientStats(StatCollector *sa) {
+        collectors.push_back(sa);
+    }
 
-    // file handlers
-    fdb_status status;
-    fdb_file_handle **dbfile = alca(fdb_file_handle*, n_kvs);
-    fdb_kvs_handle **db = alca(fdb_kvs_handle*, n2_kvs);
-    fdb_kvs_handle **snap_db = alca(fdb_kvs_handle*, n2_kvs);
-    fdb_kvs_config kvs_config = fdb_get_default_kvs_config();
-    fdb_config fconfig = fdb_get_default_config();
+    void begin() {
+        if (enabled) {
+            snapshot(&before);
+            if (baseline.count.empty()) {
+                // engine work before the first phase is not attributed
+                baseline = before;
+            }
+        }
+    }
 
-    // reader stats
-    reader_context *ctx = alca(reader_context, n2_kvs);
+    void end(const char *phase) {
 
-    StatCollector *sa = new StatCollector(4, n2_kvs);
+        size_t i;
+        if (!enabled) {
+            return;
+        }
+        snapshot(&after);
 
-    for (i = 0; i < n2_kvs; ++i) {
-        sa->t_stats[0][i].name.assign(ST_ITR_INIT);
-        sa->t_stats[1][i].name.assign(ST_ITR_NEXT);
-        sa->t_stats[2][i].name.assign(ST_ITR_GET);
-        sa->t_stats[3][i].name.assign(ST_ITR_CLOSE);
-        ctx[i].stat_itr_init = &sa->t_stats[0][i];
-        ctx[i].stat_itr_next = &sa->t_stats[1][i];
-        ctx[i].stat_itr_get = &sa->t_stats[2][i];
-        ctx[i].stat_itr_close = &sa->t_stats[3][i];
+        totals *acc = NULL;
+        for (auto &p : phases) {
+            if (p.first == phase) {
+                acc = &p.second;
+            }
+        }
+        if (!acc) {
+            phases.push_back(std::make_pair(std::string(phase), totals()));
+            acc = &phases.back().second;
+            acc->resize(after);
+        }
+        for (i = 0; i < after.count.size(); ++i) {
+            acc->count[i] += after.count[i] - before.count[i];
+            if (i < names.size()) {
+                acc->sum[i] += after.sum[i] - before.sum[i];
+            }
+        }
     }
 
-    sprintf(cmd, "rm bench* > errorlog.txt");
-    r = system(cmd);
-    (void)r;
+    void print() {
 
-    // setup
-    fconfig.compaction_mode = FDB_COMPACTION_MANUAL;
-    fconfig.auto_commit = false;
-    fconfig.compactor_sleep_duration = 600;
-    fconfig.prefetch_duration = 0;
-    fconfig.num_compactor_threads = 1;
-    fconfig.num_bgflusher_threads = 0;
+        size_t c;
+        if (!enabled || phases.empty()) {
+            return;
+        }
 
-    // open 16 dbfiles each with 16 kvs
-    for (i = 0; i < n_kvs; ++i){
-        sprintf(fname, "bench%d",i);
-        status = fdb_open(&dbfile[i], fname, &fconfig);
-        assert(status == FDB_RESULT_SUCCESS);
+        int printed = 0;
+        printf("\n========== Latency Attribution - client vs engine (µs) %n",
+               &printed);
+        fillLineWith('=', 88 - printed);
+        printf("%-9s %-15s %9s %9s %-14s %9s %9s %9s %7s %9s\n",
+               "phase", "client op", "n", "avg", "engine stat", "n", "avg",
+               "overhead", "engine%", "max");
+
+        // per phase: client latency and the engine ops it caused
+        totals run;
+        run.resize(after);
+        for (const auto &p : phases) {
+            const totals &t = p.second;
+            std::vector<bool> shown(FDB_LATENCY_NUM_STATS, false);
+
+            for (c = 0; c < names.size(); ++c) {
+                if (t.count[c] == 0) {
+                    continue;
+                }
+                run.count[c] += t.count[c];
+                run.sum[c] += t.sum[c];
+                printf("%-9s %-15s %9llu %9.03f ", p.first.c_str(),
+                       names[c].c_str(), (unsigned long long)t.count[c],
+                       t.sum[c] / t.count[c]);
+
+                int e = engineStat(names[c]);
+                size_t k = names.size() + e;
+                if (e < 0 || t.count[k] == 0) {
+                    printf("%-14s\n", "-");
+                    continue;
+                }
+                shown[e] = true;
+                printf("%-14s %9llu\n", fdb_latency_stat_name(e),
+                       (unsigned long long)t.count[k]);
+            }
 
-        for (j = i*n_kvs; j < (i*n_kvs + n_kvs); ++j){
-            sprintf(dbname, "db%d",j);
-            status = fdb_kvs_open(dbfile[i], &db[j],
-                                  dbname, &kvs_config);
-            assert(status == FDB_RESULT_SUCCESS);
+            // engine work with no client op of its own, e.g. WAL flushes
+            for (int e = 0; e < FDB_LATENCY_NUM_STATS; ++e) {
+                size_t k = names.size() + e;
+                if (shown[e] || t.count[k] == 0) {
+                    continue;
+                }
+                printf("%-9s %-15s %9s %9s %-14s %9llu\n",
+                       p.first.c_str(), "", "", "", fdb_latency_stat_name(e),
+                       (unsigned long long)t.count[k]);
+            }
         }
-    }
 
-    for (i = 0; i < 10; ++i){
-        // generate initial commit headers
-        for (i = 0; i < n_kvs; i++){
-            status = fdb_commit(dbfile[i], FDB_COMMIT_MANUAL_WAL_FLUSH);
-            assert(status == FDB_RESULT_SUCCESS);
+        // whole run, from the first begin() to the last end(): the only
+        // scope forestdb's averages can be differenced at. Client ops that
+        // share an engine stat (set and delete) are merged so both sides
+        // cover the same ops; compare the two n columns.
+        for (int e = 0; e < FDB_LATENCY_NUM_STATS; ++e) {
+            size_t k = names.size() + e;
+            std::string client;
+            uint64_t client_n = 0;
+            double client_sum = 0;
+            for (c = 0; c < names.size(); ++c) {
+                if (engineStat(names[c]) != e || run.count[c] == 0) {
+                    continue;
+                }
+                client += (client.empty() ? "" : "+") + names[c];
+                client_n += run.count[c];
+                client_sum += run.sum[c];
+            }
+            uint64_t engine_n = after.count[k] - baseline.count[k];
+            if (engine_n == 0 && client_n == 0) {
+                continue;
+            }
+            printf("%-9s %-15s ", "run", client.c_str());
+            if (client_n) {
+                printf("%9llu %9.03f ", (unsigned long long)client_n,
+                       client_sum / client_n);
+            } else {
+                printf("%9s %9s ", "", "");
+            }
+            if (engine_n == 0) {
+                printf("%-14s\n", "-");
+                continue;
+            }
+            double engine_avg = (after.sum[k] - baseline.sum[k]) / engine_n;
+            printf("%-14s %9llu %9.03f ", fdb_latency_stat_name(e),
+                   (unsigned long long)engine_n, engine_avg);
+            if (client_n) {
+                double client_avg = client_sum / client_n;
+                printf("%9.03f %6.01f%% ", client_avg - engine_avg,
+                       client_avg > 0 ? 100.0 * engine_avg / client_avg : 0);
+            } else {
+                printf("%9s %7s ", "", "");
+            }
+            printf("%9llu\n", (unsigned long long)after.max[k]);
         }
+        fillLineWith('=', 87);
     }
 
-    for (j = 0; j < n_loops; j++){
+private:
 
-        // write to single file 1 kvs
-        writer(db[0], 0);
+    // client stats first, then one entry per fdb_latency_stat_type
+    struct totals {
+        std::vector<uint64_t> count;
+        std::vector<double> sum;
+        std::vector<uint64_t> max;
 
-        // reads from single file 1 kvs
-        ctx[0].handle = db[0];
-        reader(&ctx[0]);
+        void resize(const totals &shape) {
+            count.assign(shape.count.size(), 0);
+            sum.assign(shape.count.size(), 0);
+            max.assign(shape.count.size(), 0);
+        }
+    };
+
+    // engine stat that covers the same work as a client stat
+    static int engineStat(const std::string &client) {
+
+        static const struct {
+            const char *client;
+            int engine;
+        } pairs[] = {
+            {"set",        FDB_LATENCY_SETS},
+            {"delete",     FDB_LATENCY_SETS},
+            {"get",        FDB_LATENCY_GETS},
+            {"commit",     FDB_LATENCY_COMMITS},
+            {"snapshot",   FDB_LATENCY_SNAP_INMEM},
+            {ST_ITR_INIT,  FDB_LATENCY_ITR_INIT},
+            {ST_ITR_NEXT,  FDB_LATENCY_ITR_NEXT},
+            {ST_ITR_GET,   FDB_LATENCY_ITR_GET},
+            {ST_ITR_CLOSE, FDB_LATENCY_ITR_CLOSE},
+        };
+        for (size_t i = 0; i < sizeof(pairs) / sizeof(pairs[0]); ++i) {
+            if (client == pairs[i].client) {
+                return pairs[i].engine;
+            }
+        }
+        return -1;
+    }
 
-        // snap iterator read
-        status = fdb_snapshot_open(db[0], &snap_db[0],
-                                   FDB_SNAPSHOT_INMEM);
-        assert(status == FDB_RESULT_SUCCESS);
-        ctx[0].handle = snap_db[0];
-        reader(&ctx[0]);
+    void snapshot(totals *t) {
 
-       // write/read/snap to single file 16 kvs
-        for (i = 0;i < n_kvs; ++i){
-            writer(db[i], i);
+        int i, j;
+        fdb_latency_stat stat;
+
+        t->count.clear();
+        t->sum.clear();
+        t->max.clear();
+        if (names.empty()) {
+            for (auto sa : collectors) {
+                for (i = 0; i < sa->numStats(); ++i) {
+                    names.push_back(sa->t_stats[i][0].name);
+                }
+            }
         }
-        for (i = 0; i < n_kvs; ++i){
-            deletes(db[i], i);
+        for (auto sa : collectors) {
+            for (i = 0; i < sa->numStats(); ++i) {
+                t->count.push_back(sa->count(i));
+                t->sum.push_back(sa->sum(i));
+                t->max.push_back(0);
+            }
         }
-        for (i = 0; i < n_kvs; ++i){
-            ctx[i].handle = db[i];
-            reader(&ctx[i]);
+        for (i = 0; i < FDB_LATENCY_NUM_STATS; ++i) {
+            uint64_t count = 0, max = 0;
+            double sum = 0;
+            for (j = 0; j < nfiles; ++j) {
+                memset(&stat, 0, sizeof(fdb_latency_stat));
+                if (fdb_get_latency_stats(dbfiles[j], &stat, i) !=
+                    FDB_RESULT_SUCCESS) {
+                    continue;
+                }
+                count += stat.lat_count;
+                sum += (double)stat.lat_avg * stat.lat_count;
+                max = std::max(max, (uint64_t)stat.lat_max);
+            }
+            t->count.push_back(count);
+            t->sum.push_back(sum);
+            t->max.push_back(max);
         }
-        for (i = 0; i < n_kvs; ++i){
-            status = fdb_snapshot_open(db[i], &snap_db[i],
-                                       FDB_SNAPSHOT_INMEM);
+    }
+
+    bool enabled;
+    fdb_file_handle **dbfiles;
+    int nfiles;
+    std::vector<StatCollector*> collectors;
+    std::vector<std::string> names;
+    totals baseline;            // as of the first begin()
+    totals before;
+    totals after;
+    std::vector<std::pair<std::string, totals> > phases;
+};
+
+// commit every file n_headers times to build up commit header history
+void commit_headers(fdb_file_handle **dbfile, int nfiles, int n_headers) {
+
+    int i, h;
+    fdb_status status;
+
+    for (h = 0; h < n_headers; ++h){
+        for (i = 0; i < nfiles; i++){
+            status = fdb_commit(dbfile[i], FDB_COMMIT_MANUAL_WAL_FLUSH);
+            trace_record_commit(dbfile[i], true);
             assert(status == FDB_RESULT_SUCCESS);
-            ctx[i].handle = snap_db[i];
-            reader(&ctx[i]);
         }
+    }
+    (void)status;
+}
 
-        // commit single file
-        status = fdb_commit(dbfile[0], FDB_COMMIT_MANUAL_WAL_FLUSH);
-        assert(status == FDB_RESULT_SUCCESS);
+// summary of one do_bench() run, used by the config matrix
+struct bench_result {
+    double elapsed_s;
+    uint64_t file_size;
+    std::vector<std::string> names;
+    std::vector<double> p50;
+    std::vector<double> p99;
+};
 
-        // write/write/snap to 16 files 1 kvs
-        for (i = 0; i < n2_kvs; i += n_kvs){ // every 16 kvs is new file
-            writer(db[i], i);
-        }
-        for (i = 0; i < n2_kvs; i += n_kvs){
-            deletes(db[i], i);
+// same key order as the default comparator, exercises the callback path
+int bench_keycmp(void *a, size_t len_a, void *b, size_t len_b) {
+
+    int cmp = memcmp(a, b, std::min(len_a, len_b));
+    if (cmp == 0) {
+        return (int)len_a - (int)len_b;
+    }
+    return cmp;
+}
+
+// fdb_config every scenario starts from
+fdb_config bench_config() {
+
+    fdb_config fconfig = fdb_get_default_config();
+    fconfig.compaction_mode = FDB_COMPACTION_MANUAL;
+    fconfig.auto_commit = false;
+    fconfig.compactor_sleep_duration = 600;
+    fconfig.prefetch_duration = 0;
+    fconfig.num_compactor_threads = 1;
+    fconfig.num_bgflusher_threads = 0;
+    return fconfig;
+}
+
+/*
+ * Named configurations for the config matrix. Each one changes a single
+ * knob of bench_config() so columns of the comparison table differ in
+ * exactly one setting from "default".
+ */
+std::vector<bench_profile_t> bench_profiles() {
+
+    std::vector<bench_profile_t> profiles;
+    bench_profile_t p;
+
+    p.name = "default";
+    p.fconfig = bench_config();
+    p.kvs_config = fdb_get_default_kvs_config();
+    profiles.push_back(p);
+
+    p.name = "bcache_32m";
+    p.fconfig = bench_config();
+    p.fconfig.buffercache_size = 32 * 1024 * 1024;
+    profiles.push_back(p);
+
+    p.name = "bcache_1g";
+    p.fconfig = bench_config();
+    p.fconfig.buffercache_size = 1024 * 1024 * 1024;
+    profiles.push_back(p);
+
+    p.name = "wal_64k";
+    p.fconfig = bench_config();
+    p.fconfig.wal_threshold = 65536;
+    profiles.push_back(p);
+
+    p.name = "seqtree_off";
+    p.fconfig = bench_config();
+    p.fconfig.seqtree_opt = FDB_SEQTREE_NOT_USE;
+    profiles.push_back(p);
+
+    p.name = "block_reuse_off";
+    p.fconfig = bench_config();
+    p.fconfig.block_reusing_threshold = 100;
+    profiles.push_back(p);
+
+    p.name = "compress";
+    p.fconfig = bench_config();
+    p.fconfig.compress_document_body = true;
+    profiles.push_back(p);
+
+    p.name = "bgflush_2";
+    p.fconfig = bench_config();
+    p.fconfig.num_bgflusher_threads = 2;
+    profiles.push_back(p);
+
+    p.name = "custom_cmp";
+    p.fconfig = bench_config();
+    p.kvs_config.custom_cmp = bench_keycmp;
+    p.kvs_config.custom_cmp_param = NULL;
+    profiles.push_back(p);
+
+    return profiles;
+}
+
+// size with an optional k/m/g suffix
+static bool parse_size(const char *val, uint64_t *out) {
+
+    char *end;
+    uint64_t v = strtoull(val, &end, 10);
+    if (end == val) {
+        return false;
+    }
+    switch (*end) {
+    case 'g': case 'G': v *= 1024;      // fall through
+    case 'm': case 'M': v *= 1024;      // fall through
+    case 'k': case 'K': v *= 1024; end++; break;
+    default: break;
+    }
+    *out = v;
+    return *end == '\0';
+}
+
+/*
+ * Build a profile from "name:key=value,..." as given to --profile. It
+ * starts from bench_config(), or from a built-in preset named with
+ * base=<preset>, and applies each setting in order.
+ */
+bool parse_profile(const char *def, bench_profile_t *profile) {
+
+    static const struct {
+        const char *key;
+        void (*apply)(bench_profile_t *p, uint64_t v);
+    } keys[] = {
+        {"buffercache_size", [](bench_profile_t *p, uint64_t v) {
+            p->fconfig.buffercache_size = v; }},
+        {"wal_threshold", [](bench_profile_t *p, uint64_t v) {
+            p->fconfig.wal_threshold = v; }},
+        {"wal_partitions", [](bench_profile_t *p, uint64_t v) {
+            p->fconfig.num_wal_partitions = v; }},
+        {"bcache_partitions", [](bench_profile_t *p, uint64_t v) {
+            p->fconfig.num_bcache_partitions = v; }},
+        {"seqtree", [](bench_profile_t *p, uint64_t v) {
+            p->fconfig.seqtree_opt = v ? FDB_SEQTREE_USE :
+                                         FDB_SEQTREE_NOT_USE; }},
+        {"block_reusing_threshold", [](bench_profile_t *p, uint64_t v) {
+            p->fconfig.block_reusing_threshold = v; }},
+        {"num_keeping_headers", [](bench_profile_t *p, uint64_t v) {
+            p->fconfig.num_keeping_headers = v; }},
+        {"compress", [](bench_profile_t *p, uint64_t v) {
+            p->fconfig.compress_document_body = v != 0; }},
+        {"bgflushers", [](bench_profile_t *p, uint64_t v) {
+            p->fconfig.num_bgflusher_threads = v; }},
+        {"compactors", [](bench_profile_t *p, uint64_t v) {
+            p->fconfig.num_compactor_threads = v; }},
+        {"custom_cmp", [](bench_profile_t *p, uint64_t v) {
+            p->kvs_config.custom_cmp = v ? bench_keycmp : NULL;
+            p->kvs_config.custom_cmp_param = NULL; }},
+    };
+    const int n_keys = sizeof(keys) / sizeof(keys[0]);
+
+    const char *colon = strchr(def, ':');
+    size_t name_len = colon ? (size_t)(colon - def) : strlen(def);
+    if (name_len == 0) {
+        printf("--profile %s: missing name\n", def);
+        return false;
+    }
+
+    // the name lives as long as the options do, for the whole run
+    char *name = (char*)malloc(name_len + 1);
+    memcpy(name, def, name_len);
+    name[name_len] = '\0';
+    profile->name = name;
+    profile->fconfig = bench_config();
+    profile->kvs_config = fdb_get_default_kvs_config();
+    if (!colon) {
+        return true;
+    }
+
+    std::string settings(colon + 1);
+    size_t pos = 0;
+    while (pos < settings.size()) {
+        size_t comma = settings.find(',', pos);
+        if (comma == std::string::npos) {
+            comma = settings.size();
+        }
+        std::string item = settings.substr(pos, comma - pos);
+        pos = comma + 1;
+
+        size_t eq = item.find('=');
+        if (eq == std::string::npos) {
+            printf("--profile %s: expected key=value, got \"%s\"\n",
+                   profile->name, item.c_str());
+            return false;
+        }
+        std::string key = item.substr(0, eq);
+        std::string val = item.substr(eq + 1);
+
+        if (key == "base") {
+            bool found = false;
+            for (const auto& preset : bench_profiles()) {
+                if (val == preset.name) {
+                    profile->fconfig = preset.fconfig;
+                    profile->kvs_config = preset.kvs_config;
+                    found = true;
+                }
+            }
+            if (!found) {
+                printf("--profile %s: unknown preset \"%s\"\n",
+                       profile->name, val.c_str());
+                return false;
+            }
+            continue;
+        }
+
+        int k;
+        uint64_t v;
+        for (k = 0; k < n_keys; ++k) {
+            if (key == keys[k].key) {
+                break;
+            }
+        }
+        if (k == n_keys) {
+            printf("--profile %s: unknown setting \"%s\"\n",
+                   profile->name, key.c_str());
+            return false;
+        }
+        if (!parse_size(val.c_str(), &v)) {
+            printf("--profile %s: bad value \"%s\" for %s\n",
+                   profile->name, val.c_str(), key.c_str());
+            return false;
+        }
+        keys[k].apply(profile, v);
+    }
+    return true;
+}
+
+void do_bench(const bench_opts_t *opts, const bench_profile_t *profile,
+              bench_result *result) {
+
+    int i, j, r;
+    int measured = 0;
+    int n_kvs = 16;
+
+    char cmd[64], fname[64], dbname[64];
+    int n2_kvs = n_kvs * n_kvs;
+
+    // file handlers
+    fdb_status status;
+    fdb_file_handle **dbfile = alca(fdb_file_handle*, n_kvs);
+    fdb_kvs_handle **db = alca(fdb_kvs_handle*, n2_kvs);
+    fdb_kvs_handle **snap_db = alca(fdb_kvs_handle*, n2_kvs);
+    fdb_kvs_config kvs_config = profile->kvs_config;
+    fdb_config fconfig = profile->fconfig;
+    fdb_file_info file_info;
+    ts_nsec start = get_monotonic_ts();
+    std::string title("ITERATOR_TEST_STATS");
+
+    if (strcmp(profile->name, "default")) {
+        title += "-";
+        title += profile->name;
+    }
+
+    // reader stats
+    reader_context *ctx = alca(reader_context, n2_kvs);
+
+    StatCollector *sa = new StatCollector(4, n2_kvs);
+    StatCollector *warm_sa = new StatCollector(4, n2_kvs);
+    WarmupTracker warmup(opts, sa, warm_sa);
+    std::vector<double> prev_pcts;
+
+    // client side of the latency attribution, only tracked when enabled
+    StatCollector *client_sa = new StatCollector(5, 1);
+    LatencyAttribution attr(opts->attribution, dbfile, n_kvs);
+    stat_history_t *st_set = NULL, *st_del = NULL, *st_get = NULL;
+    stat_history_t *st_snap = NULL, *st_commit = NULL;
+    ts_nsec lat;
+
+    client_sa->t_stats[0][0].name.assign("set");
+    client_sa->t_stats[1][0].name.assign("delete");
+    client_sa->t_stats[2][0].name.assign("get");
+    client_sa->t_stats[3][0].name.assign("snapshot");
+    client_sa->t_stats[4][0].name.assign("commit");
+    if (opts->attribution) {
+        st_set = &client_sa->t_stats[0][0];
+        st_del = &client_sa->t_stats[1][0];
+        st_get = &client_sa->t_stats[2][0];
+        st_snap = &client_sa->t_stats[3][0];
+        st_commit = &client_sa->t_stats[4][0];
+    }
+    attr.addClientStats(client_sa);
+    attr.addClientStats(sa);
+
+    for (i = 0; i < n2_kvs; ++i) {
+        sa->t_stats[0][i].name.assign(ST_ITR_INIT);
+        sa->t_stats[1][i].name.assign(ST_ITR_NEXT);
+        sa->t_stats[2][i].name.assign(ST_ITR_GET);
+        sa->t_stats[3][i].name.assign(ST_ITR_CLOSE);
+        ctx[i].stat_itr_init = &sa->t_stats[0][i];
+        ctx[i].stat_itr_next = &sa->t_stats[1][i];
+        ctx[i].stat_itr_get = &sa->t_stats[2][i];
+        ctx[i].stat_itr_close = &sa->t_stats[3][i];
+        ctx[i].stat_get = st_get;
+    }
+
+    sprintf(cmd, "rm bench* > errorlog.txt");
+    r = system(cmd);
+    (void)r;
+
+    // open 16 dbfiles each with 16 kvs
+    for (i = 0; i < n_kvs; ++i){
+        sprintf(fname, "bench%d",i);
+        status = fdb_open(&dbfile[i], fname, &fconfig);
+        assert(status == FDB_RESULT_SUCCESS);
+        trace_register(dbfile[i], i*n_kvs);
+
+        for (j = i*n_kvs; j < (i*n_kvs + n_kvs); ++j){
+            sprintf(dbname, "db%d",j);
+            status = fdb_kvs_open(dbfile[i], &db[j],
+                                  dbname, &kvs_config);
+            assert(status == FDB_RESULT_SUCCESS);
+            trace_register(db[j], j);
+        }
+    }
+
+    // generate initial commit headers
+    commit_headers(dbfile, n_kvs, 10);
+
+    for (j = 0; ; j++){
+
+        // write to single file 1 kvs
+        attr.begin();
+        writer(db[0], 0, st_set);
+        attr.end("write");
+
+        // reads from single file 1 kvs
+        attr.begin();
+        ctx[0].handle = db[0];
+        reader(&ctx[0]);
+        attr.end("iterate");
+
+        // snap iterator read
+        attr.begin();
+        lat = timed_fdb_snapshot(db[0], &snap_db[0]);
+        assert(lat != ERR_NS);
+        track_stat(st_snap, lat);
+        trace_register(snap_db[0], 0);
+        ctx[0].handle = snap_db[0];
+        reader(&ctx[0]);
+        fdb_kvs_close(snap_db[0]);
+        attr.end("snapshot");
+
+       // write/read/snap to single file 16 kvs
+        attr.begin();
+        for (i = 0;i < n_kvs; ++i){
+            writer(db[i], i, st_set);
+        }
+        attr.end("write");
+        attr.begin();
+        for (i = 0; i < n_kvs; ++i){
+            deletes(db[i], i, st_del);
+        }
+        attr.end("delete");
+        attr.begin();
+        for (i = 0; i < n_kvs; ++i){
+            ctx[i].handle = db[i];
+            reader(&ctx[i]);
+        }
+        attr.end("iterate");
+        attr.begin();
+        for (i = 0; i < n_kvs; ++i){
+            lat = timed_fdb_snapshot(db[i], &snap_db[i]);
+            assert(lat != ERR_NS);
+            track_stat(st_snap, lat);
+            trace_register(snap_db[i], i);
+            ctx[i].handle = snap_db[i];
+            reader(&ctx[i]);
+            fdb_kvs_close(snap_db[i]);
+        }
+        attr.end("snapshot");
+
+        // commit single file
+        attr.begin();
+        lat = timed_fdb_commit(dbfile[0], true);
+        trace_record_commit(dbfile[0], true);
+        assert(lat != ERR_NS);
+        track_stat(st_commit, lat);
+        attr.end("commit");
+
+        // write/write/snap to 16 files 1 kvs
+        attr.begin();
+        for (i = 0; i < n2_kvs; i += n_kvs){ // every 16 kvs is new file
+            writer(db[i], i, st_set);
         }
+        attr.end("write");
+        attr.begin();
+        for (i = 0; i < n2_kvs; i += n_kvs){
+            deletes(db[i], i, st_del);
+        }
+        attr.end("delete");
+        attr.begin();
         for (i = 0; i < n2_kvs; i += n_kvs){ // every 16 kvs is new file
             ctx[i].handle = db[i];
             reader(&ctx[i]);
         }
+        attr.end("iterate");
+        attr.begin();
         for (i = 0; i < n2_kvs; i += n_kvs){
-            status = fdb_snapshot_open(db[i], &snap_db[i],
-                                       FDB_SNAPSHOT_INMEM);
-            assert(status == FDB_RESULT_SUCCESS);
+            lat = timed_fdb_snapshot(db[i], &snap_db[i]);
+            assert(lat != ERR_NS);
+            track_stat(st_snap, lat);
+            trace_register(snap_db[i], i);
             ctx[i].handle = snap_db[i];
             reader(&ctx[i]);
+            fdb_kvs_close(snap_db[i]);
         }
+        attr.end("snapshot");
 
         // write to 16 files 16 kvs each
+        attr.begin();
         for (i = 0; i < n2_kvs; i++){
-            writer(db[i], i);
+            writer(db[i], i, st_set);
         }
+        attr.end("write");
+        attr.begin();
         for (i = 0; i < n2_kvs; ++i){
-            deletes(db[i], i);
+            deletes(db[i], i, st_del);
         }
+        attr.end("delete");
+        attr.begin();
         for (i = 0; i < n2_kvs; i++){
             ctx[i].handle = db[i];
             reader(&ctx[i]);
         }
+        attr.end("iterate");
+        attr.begin();
         for (i = 0; i < n2_kvs; i++){
-            status = fdb_snapshot_open(db[i], &snap_db[i],
-                                       FDB_SNAPSHOT_INMEM);
-            assert(status == FDB_RESULT_SUCCESS);
+            lat = timed_fdb_snapshot(db[i], &snap_db[i]);
+            assert(lat != ERR_NS);
+            track_stat(st_snap, lat);
+            trace_register(snap_db[i], i);
             ctx[i].handle = snap_db[i];
             reader(&ctx[i]);
+            fdb_kvs_close(snap_db[i]);
         }
+        attr.end("snapshot");
 
         // commit all
+        attr.begin();
         for (i = 0;i < n_kvs; i++){
-            status = fdb_commit(dbfile[i], FDB_COMMIT_MANUAL_WAL_FLUSH);
-            assert(status == FDB_RESULT_SUCCESS);
+            lat = timed_fdb_commit(dbfile[i], true);
+            trace_record_commit(dbfile[i], true);
+            assert(lat != ERR_NS);
+            track_stat(st_commit, lat);
+        }
+        attr.end("commit");
+
+        // warmup loops are discarded from the measured stats
+        if (warmup.inWarmup()) {
+            warmup.loopDone();
+            continue;
+        }
+
+        // run at least n_loops, then until percentiles settle
+        measured++;
+        bool converged = opts->converge_tol <= 0 ||
+                         percentiles_converged(sa, prev_pcts,
+                                               opts->converge_tol);
+        if (measured >= opts->max_loops ||
+            (measured >= opts->n_loops && converged)) {
+            break;
         }
     }
     // compact all
@@ -539,17 +1549,47 @@ void do_bench() {
         assert(status == FDB_RESULT_SUCCESS);
     }
 
+    if (result) {
+        result->elapsed_s = ts_diff(start, get_monotonic_ts()) / 1e6;
+        result->file_size = 0;
+        for (i = 0; i < n_kvs; i++){
+            status = fdb_get_file_info(dbfile[i], &file_info);
+            assert(status == FDB_RESULT_SUCCESS);
+            result->file_size += file_info.file_size;
+        }
+        for (const auto& st : sa->summarize(true)) {
+            result->names.push_back(sa->t_stats[st.stat][0].name);
+            result->p50.push_back(st.median);
+            result->p99.push_back(st.pct99);
+        }
+    }
+
+    // print discarded warmup stats separately
+    if (warmup.warmupLoops() > 0) {
+        printf("\n  warmup: %d loops, %llu samples discarded\n",
+               warmup.warmupLoops(), (unsigned long long)warmup.warmupOps());
+        warm_sa->aggregateAndPrintAll((title + "-WARMUP").c_str(),
+                                      n_kvs * n_kvs, "µs");
+    }
+    delete warm_sa;
+
     // print aggregated reader stats
-    sa->aggregateAndPrintAll("ITERATOR_TEST_STATS", n_kvs * n_kvs, "µs");
+    if (measured != opts->n_loops) {
+        printf("\n  measured: %d loops\n", measured);
+    }
+    sa->aggregateAndPrintAll(title.c_str(), n_kvs * n_kvs, "µs");
     delete sa;
 
     // print aggregated dbfile stats
     print_db_stats(dbfile, n_kvs);
 
+    // print client vs engine split per phase
+    attr.print();
+    delete client_sa;
+
     // cleanup
     for(i = 0; i < n2_kvs; i++){
         fdb_kvs_close(db[i]);
-        fdb_kvs_close(snap_db[i]);
     }
     for(i = 0; i < n_kvs; i++){
         fdb_close(dbfile[i]);
@@ -563,13 +1603,2223 @@ void do_bench() {
     (void)r;
 }
 
+#if !defined(WIN32) && !defined(_WIN32)
+// load ndocs committed docs, leave wal_docs committed updates unflushed in
+// the WAL, signal the parent and keep writing uncommitted docs until killed
+void recovery_child(fdb_config *fconfig, int ndocs, int wal_docs,
+                    int ready_fd) {
+
+    int i;
+    char keybuf[256], bodybuf[512];
+    fdb_file_handle *dbfile;
+    fdb_kvs_handle *db;
+    fdb_kvs_config kvs_config = fdb_get_default_kvs_config();
+    fdb_doc *doc = NULL;
+    fdb_status status;
+
+    str_gen(bodybuf, 512);
+    status = fdb_open(&dbfile, "bench_recovery", fconfig);
+    assert(status == FDB_RESULT_SUCCESS);
+    status = fdb_kvs_open(dbfile, &db, "db0", &kvs_config);
+    assert(status == FDB_RESULT_SUCCESS);
+
+    for (i = 0; i < ndocs; ++i) {
+        sprintf(keybuf, "%dreckey", i);
+        fdb_doc_create(&doc, keybuf, strlen(keybuf), NULL, 0,
+                       bodybuf, strlen(bodybuf));
+        fdb_set(db, doc);
+        fdb_doc_free(doc);
+    }
+    status = fdb_commit(dbfile, FDB_COMMIT_MANUAL_WAL_FLUSH);
+    assert(status == FDB_RESULT_SUCCESS);
+
+    // updates that only live in the WAL and must be replayed on open
+    for (i = 0; i < wal_docs; ++i) {
+        sprintf(keybuf, "%dreckey", i % ndocs);
+        fdb_doc_create(&doc, keybuf, strlen(keybuf), NULL, 0,
+                       bodybuf, strlen(bodybuf));
+        fdb_set(db, doc);
+        fdb_doc_free(doc);
+    }
+    status = fdb_commit(dbfile, FDB_COMMIT_NORMAL);
+    assert(status == FDB_RESULT_SUCCESS);
+
+    if (write(ready_fd, "r", 1) != 1) {
+        _exit(1);
+    }
+
+    // uncommitted writes in flight when the parent kills us
+    for (i = 0; ; ++i) {
+        sprintf(keybuf, "%duncommitted", i);
+        fdb_doc_create(&doc, keybuf, strlen(keybuf), NULL, 0,
+                       bodybuf, strlen(bodybuf));
+        fdb_set(db, doc);
+        fdb_doc_free(doc);
+    }
+    (void)status;
+}
+#endif
+
 /*
- *  ===================
- *  FDB BENCH MARK TEST
- *  ===================
- *  Performs unit benchmarking with 16 dbfiles each with max 16 kvs
+ * Crash-recovery benchmark: a forked child writes committed docs plus a
+ * WAL of committed-but-unflushed updates and is killed with SIGKILL while
+ * writing uncommitted docs. The parent then times fdb_open + fdb_kvs_open
+ * of the unclean file and verifies the recovered doc count and seqnum.
  */
-int main(int argc, char* args[]) {
+void do_recovery_bench(const bench_opts_t *opts) {
+
+#if !defined(WIN32) && !defined(_WIN32)
+    static const uint64_t wal_thresholds[] = {1024, 4096, 16384, 65536};
+    static const int file_docs[] = {10000, 100000};
+    const int n_wal = sizeof(wal_thresholds) / sizeof(wal_thresholds[0]);
+    const int n_sizes = sizeof(file_docs) / sizeof(file_docs[0]);
+    const int n_trials = 5;
+
+    int i, j, t, r;
+    char cmd[64], title[64];
+    fdb_status status;
+    fdb_file_handle *dbfile;
+    fdb_kvs_handle *db;
+    fdb_kvs_info kvs_info;
+    fdb_file_info file_info;
+    fdb_kvs_config kvs_config = fdb_get_default_kvs_config();
+    fdb_config fconfig = bench_config();
+
+    for (i = 0; i < n_wal; ++i) {
+        for (j = 0; j < n_sizes; ++j) {
+            int ndocs = file_docs[j];
+            int wal_docs = (int)(wal_thresholds[i] * 9 / 10);
+            uint64_t file_size = 0;
+            int failures = 0;
+
+            StatCollector *sa = new StatCollector(2, 1);
+            sa->t_stats[0][0].name.assign("recovery_open");
+            sa->t_stats[1][0].name.assign("recovery_kvs_open");
+            fconfig.wal_threshold = wal_thresholds[i];
+
+            for (t = 0; t < n_trials; ++t) {
+                int fds[2];
+                char c;
+
+                sprintf(cmd, "rm bench* > errorlog.txt");
+                r = system(cmd);
+
+                r = pipe(fds);
+                assert(r == 0);
+                pid_t pid = fork();
+                assert(pid >= 0);
+                if (pid == 0) {
+                    close(fds[0]);
+                    recovery_child(&fconfig, ndocs, wal_docs, fds[1]);
+                    _exit(0);
+                }
+                close(fds[1]);
+                r = read(fds[0], &c, 1);
+                close(fds[0]);
+
+                // let the child get some uncommitted writes in flight
+                usleep(10000);
+                kill(pid, SIGKILL);
+                waitpid(pid, NULL, 0);
+                if (r != 1) {
+                    failures++;
+                    continue;
+                }
+
+                if (!track_stat(&sa->t_stats[0][0],
+                                timed_fdb_open(&dbfile, "bench_recovery",
+                                               &fconfig))) {
+                    failures++;
+                    continue;
+                }
+                if (!track_stat(&sa->t_stats[1][0],
+                                timed_fdb_kvs_open(dbfile, &db, "db0",
+                                                   &kvs_config))) {
+                    failures++;
+                    fdb_close(dbfile);
+                    fdb_shutdown();
+                    continue;
+                }
+
+                status = fdb_get_kvs_info(db, &kvs_info);
+                assert(status == FDB_RESULT_SUCCESS);
+                if (kvs_info.doc_count != (uint64_t)ndocs ||
+                    kvs_info.last_seqnum != (fdb_seqnum_t)(ndocs + wal_docs)) {
+                    failures++;
+                }
+                status = fdb_get_file_info(dbfile, &file_info);
+                assert(status == FDB_RESULT_SUCCESS);
+                file_size = file_info.file_size;
+
+                fdb_kvs_close(db);
+                fdb_close(dbfile);
+                // child must fork from a process with no forestdb state
+                fdb_shutdown();
+            }
+
+            sprintf(title, "RECOVERY-WAL%llu-DOCS%d",
+                    (unsigned long long)wal_thresholds[i], ndocs);
+            printf("\n  %s: file %llu bytes, %d wal docs, "
+                   "%d/%d trials failed verification\n",
+                   title, (unsigned long long)file_size, wal_docs,
+                   failures, n_trials);
+            sa->aggregateAndPrintAll(title, n_trials, "ms");
+            delete sa;
+        }
+    }
+
+    (void)status;
+    sprintf(cmd, "rm bench* > errorlog.txt");
+    r = system(cmd);
+    (void)r;
+#else
+    printf("\nrecovery benchmark requires fork(), skipping\n");
+#endif
+    (void)opts;
+}
+
+struct replay_context {
+    const trace_reader_t *trace;
+    const bench_opts_t *opts;
+    int id;                     // thread id, owns files id % n_threads
+    int n_threads;
+    int n_kvs;                  // kvs per file
+    fdb_file_handle **dbfile;
+    fdb_kvs_handle **db;
+    StatCollector *sa;
+    ts_nsec start;
+    uint64_t misses;
+};
+
+void replay_worker(replay_context *ctx) {
+
+    size_t pos = 0;
+    const char *key;
+    const trace_rec_t *rec;
+    std::vector<char> bodybuf;
+    fdb_doc *doc = NULL;
+
+    while ((rec = trace_next(ctx->trace, &pos, &key))) {
+        int file = rec->kvs_id / ctx->n_kvs;
+        if (file % ctx->n_threads != ctx->id) {
+            continue;
+        }
+
+        // timestamp-faithful replay, scaled by replay_speed
+        if (ctx->opts->replay_speed > 0) {
+            ts_nsec due = ctx->start +
+                          (ts_nsec)(rec->ts / ctx->opts->replay_speed);
+            ts_nsec now = get_monotonic_ts();
+            if (due > now) {
+                usleep((due - now) / 1000);
+            }
+        }
+
+        fdb_kvs_handle *kv = ctx->db[rec->kvs_id];
+        stat_history_t *stat = &ctx->sa->t_stats[rec->op][ctx->id];
+        switch (rec->op) {
+        case TRACE_OP_SET:
+            if (bodybuf.size() < rec->value_size + 1) {
+                bodybuf.resize(rec->value_size + 1);
+                str_gen(&bodybuf[0], bodybuf.size());
+            }
+            fdb_doc_create(&doc, key, rec->key_len, NULL, 0,
+                           &bodybuf[0], rec->value_size);
+            track_stat(stat, timed_fdb_set(kv, doc));
+            break;
+        case TRACE_OP_GET:
+            fdb_doc_create(&doc, key, rec->key_len, NULL, 0, NULL, 0);
+            if (!track_stat(stat, timed_fdb_get(kv, doc))) {
+                ctx->misses++;
+            }
+            break;
+        case TRACE_OP_DEL:
+            fdb_doc_create(&doc, key, rec->key_len, NULL, 0, NULL, 0);
+            track_stat(stat, timed_fdb_delete(kv, doc));
+            break;
+        case TRACE_OP_COMMIT:
+            track_stat(stat, timed_fdb_commit(ctx->dbfile[file],
+                                              rec->value_size != 0));
+            break;
+        }
+        if (doc) {
+            fdb_doc_free(doc);
+            doc = NULL;
+        }
+    }
+}
+
+/*
+ * Replay a trace recorded with --record against freshly created bench%d
+ * files laid out like do_bench() (n_kvs kvs per file, kvs id i is db<i>
+ * in file i / n_kvs). Files are split between replay threads so every
+ * handle is only ever used by one thread.
+ */
+void do_replay_bench(const bench_opts_t *opts) {
+
+    int i, j, r;
+    int n_kvs = 16;
+    int n_files, n_threads = opts->replay_threads;
+    char cmd[64], fname[64], dbname[64];
+    size_t pos = 0;
+    const char *key;
+    const trace_rec_t *rec;
+    uint64_t n_ops = 0;
+    uint16_t max_id = 0;
+    trace_reader_t trace;
+    fdb_status status;
+    fdb_kvs_config kvs_config = fdb_get_default_kvs_config();
+    fdb_config fconfig = bench_config();
+
+    if (trace_open_reader(&trace, opts->replay_path) != 0) {
+        printf("\ncannot open trace %s, skipping replay\n",
+               opts->replay_path);
+        return;
+    }
+    while ((rec = trace_next(&trace, &pos, &key))) {
+        max_id = std::max(max_id, rec->kvs_id);
+        n_ops++;
+    }
+    n_files = max_id / n_kvs + 1;
+
+    sprintf(cmd, "rm bench* > errorlog.txt");
+    r = system(cmd);
+    (void)r;
+
+    std::vector<fdb_file_handle*> dbfile(n_files);
+    std::vector<fdb_kvs_handle*> db(n_files * n_kvs);
+    for (i = 0; i < n_files; ++i) {
+        sprintf(fname, "bench%d", i);
+        status = fdb_open(&dbfile[i], fname, &fconfig);
+        assert(status == FDB_RESULT_SUCCESS);
+        for (j = i*n_kvs; j < (i*n_kvs + n_kvs); ++j) {
+            sprintf(dbname, "db%d", j);
+            status = fdb_kvs_open(dbfile[i], &db[j], dbname, &kvs_config);
+            assert(status == FDB_RESULT_SUCCESS);
+        }
+    }
+
+    n_threads = std::max(1, std::min(n_threads, n_files));
+    StatCollector *sa = new StatCollector(TRACE_NUM_OPS, n_threads);
+    std::vector<replay_context> ctx(n_threads);
+    std::vector<std::thread> threads;
+    ts_nsec start = get_monotonic_ts();
+    for (i = 0; i < n_threads; ++i) {
+        sa->t_stats[TRACE_OP_SET][i].name.assign("replay_set");
+        sa->t_stats[TRACE_OP_GET][i].name.assign("replay_get");
+        sa->t_stats[TRACE_OP_DEL][i].name.assign("replay_delete");
+        sa->t_stats[TRACE_OP_COMMIT][i].name.assign("replay_commit");
+        ctx[i].trace = &trace;
+        ctx[i].opts = opts;
+        ctx[i].id = i;
+        ctx[i].n_threads = n_threads;
+        ctx[i].n_kvs = n_kvs;
+        ctx[i].dbfile = &dbfile[0];
+        ctx[i].db = &db[0];
+        ctx[i].sa = sa;
+        ctx[i].start = start;
+        ctx[i].misses = 0;
+    }
+    for (i = 0; i < n_threads; ++i) {
+        threads.push_back(std::thread(replay_worker, &ctx[i]));
+    }
+    uint64_t misses = 0;
+    for (i = 0; i < n_threads; ++i) {
+        threads[i].join();
+        misses += ctx[i].misses;
+    }
+    double elapsed_s = ts_diff(start, get_monotonic_ts()) / 1e6;
+
+    printf("\n  REPLAY: %llu ops in %.03f s (%.0f ops/s), %d threads, "
+           "%llu get misses\n", (unsigned long long)n_ops, elapsed_s,
+           elapsed_s > 0 ? n_ops / elapsed_s : 0, n_threads,
+           (unsigned long long)misses);
+    sa->aggregateAndPrintAll("REPLAY", n_threads, "µs");
+    delete sa;
+
+    for (i = 0; i < n_files * n_kvs; ++i) {
+        fdb_kvs_close(db[i]);
+    }
+    for (i = 0; i < n_files; ++i) {
+        fdb_close(dbfile[i]);
+    }
+    fdb_shutdown();
+    trace_close_reader(&trace);
+
+    (void)status;
+    sprintf(cmd, "rm bench* > errorlog.txt");
+    r = system(cmd);
+    (void)r;
+}
+
+// open and close a scratch file with the profile to see if this forestdb
+// build supports it (e.g. compression needs snappy)
+bool profile_supported(bench_profile_t *profile) {
+
+    int r;
+    fdb_file_handle *dbfile;
+    fdb_kvs_handle *db;
+    fdb_status status;
+
+    status = fdb_open(&dbfile, "bench_probe", &profile->fconfig);
+    if (status == FDB_RESULT_SUCCESS) {
+        status = fdb_kvs_open(dbfile, &db, "db0", &profile->kvs_config);
+        if (status == FDB_RESULT_SUCCESS) {
+            fdb_kvs_close(db);
+        }
+        fdb_close(dbfile);
+    }
+    fdb_shutdown();
+    r = system("rm bench_probe* > errorlog.txt");
+    (void)r;
+
+    if (status != FDB_RESULT_SUCCESS) {
+        printf("\n  profile %s: %s, skipping\n", profile->name,
+               fdb_error_msg(status));
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Run the iterator benchmark once per selected profile and print the
+ * median and 99th percentile of every stat side by side, plus wall time
+ * and on-disk size after compaction.
+ */
+void do_matrix_bench(const bench_opts_t *opts) {
+
+    size_t i, k;
+    std::vector<bench_profile_t> all = bench_profiles();
+    std::vector<bench_profile_t> profiles;
+    std::vector<bench_result> results;
+
+    // --profile definitions replace a preset of the same name
+    for (const auto& custom : opts->custom_profiles) {
+        for (i = 0; i < all.size(); ++i) {
+            if (!strcmp(all[i].name, custom.name)) {
+                break;
+            }
+        }
+        if (i < all.size()) {
+            all[i] = custom;
+        } else {
+            all.push_back(custom);
+        }
+    }
+
+    // without --profiles run everything, or just the --profile ones
+    std::string list = ",";
+    if (opts->profiles) {
+        list += std::string(opts->profiles) + ",";
+    } else if (!opts->custom_profiles.empty()) {
+        for (const auto& custom : opts->custom_profiles) {
+            list += std::string(custom.name) + ",";
+        }
+    } else {
+        list = ",all,";
+    }
+
+    for (i = 0; i < all.size(); ++i) {
+        std::string name = std::string(",") + all[i].name + ",";
+        if (list == ",all," || list.find(name) != std::string::npos) {
+            if (profile_supported(&all[i])) {
+                profiles.push_back(all[i]);
+            }
+        }
+    }
+    if (profiles.empty()) {
+        printf("\nno usable profiles in \"%s\"\n",
+               list.substr(1, list.size() - 2).c_str());
+        return;
+    }
+
+    results.resize(profiles.size());
+    for (i = 0; i < profiles.size(); ++i) {
+        do_bench(opts, &profiles[i], &results[i]);
+    }
+
+    int printed = 0;
+    printf("\n========== Config Matrix - median / 99th (µs) %n", &printed);
+    fillLineWith('=', 88 - printed);
+    printf("%-16s", "");
+    for (i = 0; i < profiles.size(); ++i) {
+        printf(" %17s", profiles[i].name);
+    }
+    putchar('\n');
+    for (k = 0; k < results[0].names.size(); ++k) {
+        printf("%-16s", results[0].names[k].c_str());
+        for (i = 0; i < results.size(); ++i) {
+            printf(" %8.03f/%8.03f", results[i].p50[k], results[i].p99[k]);
+        }
+        putchar('\n');
+    }
+    printf("%-16s", "wall_time(s)");
+    for (i = 0; i < results.size(); ++i) {
+        printf(" %17.03f", results[i].elapsed_s);
+    }
+    printf("\n%-16s", "file_size(MB)");
+    for (i = 0; i < results.size(); ++i) {
+        printf(" %17.03f", results[i].file_size / (1024.0 * 1024.0));
+    }
+    putchar('\n');
+    fillLineWith('=', 87);
+}
+
+/*
+ * Sustained write load while sweeping num_bgflusher_threads and
+ * wal_threshold. Every round writes docs across a few files, issues a
+ * normal commit every commit_every sets (forestdb flushes the WAL inside
+ * the commit once it is over wal_threshold) and ends with a manual WAL
+ * flush commit, so set, commit and flush latencies can be compared as
+ * the WAL fills up.
+ */
+void do_bgflush_bench(const bench_opts_t *opts) {
+
+    static const size_t flusher_threads[] = {0, 1, 4};
+    static const uint64_t wal_thresholds[] = {1024, 4096, 65536};
+    const int n_flushers = sizeof(flusher_threads) / sizeof(flusher_threads[0]);
+    const int n_wal = sizeof(wal_thresholds) / sizeof(wal_thresholds[0]);
+    const int n_files = 4;
+    const int docs_per_round = 100000;
+    const int commit_every = 1000;
+
+    int i, j, f, c, n, round, r;
+    char cmd[64], fname[64], title[64], keybuf[256], bodybuf[512];
+    fdb_status status;
+    fdb_file_handle *dbfile[n_files];
+    fdb_kvs_handle *db[n_files];
+    fdb_kvs_config kvs_config = fdb_get_default_kvs_config();
+    fdb_doc *doc = NULL;
+
+    str_gen(bodybuf, 512);
+
+    for (i = 0; i < n_flushers; ++i) {
+        for (j = 0; j < n_wal; ++j) {
+            fdb_config fconfig = bench_config();
+            fconfig.num_bgflusher_threads = flusher_threads[i];
+            fconfig.wal_threshold = wal_thresholds[j];
+
+            sprintf(cmd, "rm bench* > errorlog.txt");
+            r = system(cmd);
+
+            for (f = 0; f < n_files; ++f) {
+                sprintf(fname, "bench%d", f);
+                status = fdb_open(&dbfile[f], fname, &fconfig);
+                assert(status == FDB_RESULT_SUCCESS);
+                status = fdb_kvs_open(dbfile[f], &db[f], "db0", &kvs_config);
+                assert(status == FDB_RESULT_SUCCESS);
+            }
+
+            StatCollector *sa = new StatCollector(3, n_files);
+            for (f = 0; f < n_files; ++f) {
+                sa->t_stats[0][f].name.assign("bgflush_set");
+                sa->t_stats[1][f].name.assign("bgflush_commit");
+                sa->t_stats[2][f].name.assign("bgflush_walflush");
+            }
+
+            ts_nsec start = get_monotonic_ts();
+            for (round = 0; round < opts->n_loops; ++round) {
+                for (n = 0; n < docs_per_round; ++n) {
+                    f = n % n_files;
+                    // overwrite a bounded key space so the WAL sees updates
+                    sprintf(keybuf, "%dbgkey", (round * 7919 + n) % 50000);
+                    fdb_doc_create(&doc, keybuf, strlen(keybuf), NULL, 0,
+                                   bodybuf, strlen(bodybuf));
+                    track_stat(&sa->t_stats[0][f], timed_fdb_set(db[f], doc));
+                    fdb_doc_free(doc);
+
+                    if ((n + 1) % (commit_every * n_files) == 0) {
+                        for (c = 0; c < n_files; ++c) {
+                            track_stat(&sa->t_stats[1][c],
+                                       timed_fdb_commit(dbfile[c], false));
+                        }
+                    }
+                }
+                for (f = 0; f < n_files; ++f) {
+                    track_stat(&sa->t_stats[2][f],
+                               timed_fdb_commit(dbfile[f], true));
+                }
+            }
+            double elapsed_s = ts_diff(start, get_monotonic_ts()) / 1e6;
+
+            sprintf(title, "BGFLUSH-T%d-WAL%llu", (int)flusher_threads[i],
+                    (unsigned long long)wal_thresholds[j]);
+            printf("\n  %s: %.0f sets/s\n", title,
+                   elapsed_s > 0 ?
+                   (double)docs_per_round * opts->n_loops / elapsed_s : 0);
+            sa->aggregateAndPrintAll(title, n_files, "µs");
+            delete sa;
+
+            for (f = 0; f < n_files; ++f) {
+                fdb_kvs_close(db[f]);
+                fdb_close(dbfile[f]);
+            }
+            // bgflusher thread count is global, it only changes on restart
+            fdb_shutdown();
+        }
+    }
+
+    (void)status;
+    sprintf(cmd, "rm bench* > errorlog.txt");
+    r = system(cmd);
+    (void)r;
+}
+
+/*
+ * Intrusive lock-free multi-producer single-consumer queue (Vyukov).
+ * push() may be called from any thread, pop() only from the consumer;
+ * pop() returns NULL when empty or while a push is half way through.
+ */
+struct mpsc_node {
+    std::atomic<mpsc_node*> next;
+};
+
+class MpscQueue {
+public:
+    MpscQueue() : head(&stub), tail(&stub) {
+        stub.next.store(NULL, std::memory_order_relaxed);
+    }
+
+    void push(mpsc_node *n) {
+        n->next.store(NULL, std::memory_order_relaxed);
+        mpsc_node *prev = head.exchange(n, std::memory_order_acq_rel);
+        prev->next.store(n, std::memory_order_release);
+    }
+
+    mpsc_node *pop() {
+        mpsc_node *t = tail;
+        mpsc_node *next = t->next.load(std::memory_order_acquire);
+        if (t == &stub) {
+            if (!next) {
+                return NULL;
+            }
+            tail = next;
+            t = next;
+            next = next->next.load(std::memory_order_acquire);
+        }
+        if (next) {
+            tail = next;
+            return t;
+        }
+        if (t != head.load(std::memory_order_acquire)) {
+            return NULL;
+        }
+        push(&stub);
+        next = t->next.load(std::memory_order_acquire);
+        if (next) {
+            tail = next;
+            return t;
+        }
+        return NULL;
+    }
+
+private:
+    std::atomic<mpsc_node*> head;
+    mpsc_node *tail;
+    mpsc_node stub;
+};
+
+// one client write waiting to be made durable
+struct gc_request {
+    mpsc_node node;             // must stay first
+    fdb_doc *doc;
+    std::atomic<bool> acked;
+};
+
+// a batch is committed once any limit is reached
+struct gc_policy {
+    const char *name;
+    size_t max_docs;
+    size_t max_bytes;
+    uint64_t max_wait_us;       // since the first doc of the batch
+};
+
+struct gc_context {
+    MpscQueue queue;
+    fdb_file_handle *dbfile;
+    fdb_kvs_handle *db;
+    const gc_policy *policy;
+    std::atomic<int> clients_running;
+    StatCollector *sa;          // per client acks, committer in last slot
+    uint64_t batches;
+    uint64_t batched_docs;
+    uint64_t closed_by[3];      // batches closed on docs, bytes, wait
+};
+
+// Keep up to window writes in flight; acks arrive in queue order, so
+// waiting on the oldest outstanding request is enough. Body sizes vary so
+// batches can close on either the doc or the byte limit.
+void gc_client(gc_context *ctx, int id, int n_writes, int window) {
+
+    int i;
+    char keybuf[256], bodybuf[4096];
+    std::vector<gc_request> reqs(window);
+    std::vector<ts_nsec> starts(window);
+    unsigned int seed = id + 1;
+
+    str_gen(bodybuf, sizeof(bodybuf));
+    for (i = 0; i < n_writes + window; ++i) {
+        gc_request& req = reqs[i % window];
+
+        if (i >= window) {
+            while (!req.acked.load(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+            track_stat(&ctx->sa->t_stats[0][id],
+                       ts_diff(starts[i % window], get_monotonic_ts()));
+            fdb_doc_free(req.doc);
+        }
+        if (i >= n_writes) {
+            continue;
+        }
+
+        size_t bodylen = 64 + value_rand(&seed) % (sizeof(bodybuf) - 64);
+        sprintf(keybuf, "%d_%dgckey", id, i);
+        fdb_doc_create(&req.doc, keybuf, strlen(keybuf), NULL, 0,
+                       bodybuf, bodylen);
+        req.acked.store(false, std::memory_order_relaxed);
+
+        starts[i % window] = get_monotonic_ts();
+        ctx->queue.push(&req.node);
+    }
+    ctx->clients_running--;
+}
+
+void gc_committer(gc_context *ctx) {
+
+    int slot = ctx->sa->numSamples() - 1;
+    std::vector<gc_request*> batch;
+    size_t bytes = 0;
+    ts_nsec first = 0;
+
+    while (true) {
+        gc_request *req = (gc_request*)ctx->queue.pop();
+        if (req) {
+            if (batch.empty()) {
+                first = get_monotonic_ts();
+            }
+            track_stat(&ctx->sa->t_stats[1][slot],
+                       timed_fdb_set(ctx->db, req->doc));
+            bytes += req->doc->keylen + req->doc->bodylen;
+            batch.push_back(req);
+        }
+
+        if (!req) {
+            if (batch.empty() && ctx->clients_running.load() == 0) {
+                break;
+            }
+            std::this_thread::yield();
+        }
+        if (batch.empty()) {
+            continue;
+        }
+        if (batch.size() >= ctx->policy->max_docs) {
+            ctx->closed_by[0]++;
+        } else if (bytes >= ctx->policy->max_bytes) {
+            ctx->closed_by[1]++;
+        } else if ((uint64_t)ts_diff(first, get_monotonic_ts()) >=
+                   ctx->policy->max_wait_us) {
+            ctx->closed_by[2]++;
+        } else {
+            continue;
+        }
+
+        track_stat(&ctx->sa->t_stats[2][slot],
+                   timed_fdb_commit(ctx->dbfile, false));
+        for (auto b : batch) {
+            b->acked.store(true, std::memory_order_release);
+        }
+        ctx->batches++;
+        ctx->batched_docs += batch.size();
+        batch.clear();
+        bytes = 0;
+    }
+}
+
+/*
+ * Group commit: client threads each keep a window of writes in flight
+ * through a lock-free queue to a single committer, which applies them
+ * with fdb_set and makes a whole batch durable with one commit before
+ * acknowledging it. Clients * window covers the largest batch and body
+ * sizes straddle each byte limit, so every limit of a policy can close a
+ * batch. Reports acknowledged write latency, throughput and which limit
+ * closed the batches per batching policy.
+ */
+void do_group_commit_bench(const bench_opts_t *opts) {
+
+    static const gc_policy policies[] = {
+        {"B1",   1,   0,           0},
+        {"B16",  16,  32 * 1024,   100},
+        {"B64",  64,  128 * 1024,  500},
+        {"B256", 256, 512 * 1024,  2000},
+    };
+    const int n_policies = sizeof(policies) / sizeof(policies[0]);
+    const int n_clients = 16;
+    const int window = 32;      // n_clients * window > largest max_docs
+    const int n_writes = 2000;
+
+    int i, c, r;
+    char cmd[64], title[64];
+    fdb_status status;
+    fdb_kvs_config kvs_config = fdb_get_default_kvs_config();
+    fdb_config fconfig = bench_config();
+
+    for (i = 0; i < n_policies; ++i) {
+        gc_context ctx;
+        std::vector<std::thread> clients;
+
+        sprintf(cmd, "rm bench* > errorlog.txt");
+        r = system(cmd);
+
+        status = fdb_open(&ctx.dbfile, "bench0", &fconfig);
+        assert(status == FDB_RESULT_SUCCESS);
+        status = fdb_kvs_open(ctx.dbfile, &ctx.db, "db0", &kvs_config);
+        assert(status == FDB_RESULT_SUCCESS);
+
+        ctx.policy = &policies[i];
+        ctx.clients_running = n_clients;
+        ctx.batches = 0;
+        ctx.batched_docs = 0;
+        ctx.closed_by[0] = ctx.closed_by[1] = ctx.closed_by[2] = 0;
+        ctx.sa = new StatCollector(3, n_clients + 1);
+        for (c = 0; c <= n_clients; ++c) {
+            ctx.sa->t_stats[0][c].name.assign("gc_ack");
+            ctx.sa->t_stats[1][c].name.assign("gc_set");
+            ctx.sa->t_stats[2][c].name.assign("gc_commit");
+        }
+
+        ts_nsec start = get_monotonic_ts();
+        std::thread committer(gc_committer, &ctx);
+        for (c = 0; c < n_clients; ++c) {
+            clients.push_back(std::thread(gc_client, &ctx, c, n_writes,
+                                          window));
+        }
+        for (c = 0; c < n_clients; ++c) {
+            clients[c].join();
+        }
+        committer.join();
+        double elapsed_s = ts_diff(start, get_monotonic_ts()) / 1e6;
+
+        sprintf(title, "GROUP_COMMIT-%s", policies[i].name);
+        printf("\n  %s: %.0f acked writes/s, %llu commits, "
+               "%.01f docs per batch\n", title,
+               elapsed_s > 0 ? n_clients * n_writes / elapsed_s : 0,
+               (unsigned long long)ctx.batches,
+               ctx.batches ? (double)ctx.batched_docs / ctx.batches : 0);
+        printf("  batches closed on docs %llu, bytes %llu, wait %llu\n",
+               (unsigned long long)ctx.closed_by[0],
+               (unsigned long long)ctx.closed_by[1],
+               (unsigned long long)ctx.closed_by[2]);
+        ctx.sa->aggregateAndPrintAll(title, n_clients, "µs");
+        delete ctx.sa;
+
+        fdb_kvs_close(ctx.db);
+        fdb_close(ctx.dbfile);
+    }
+    fdb_shutdown();
+
+    (void)opts;
+    (void)status;
+    sprintf(cmd, "rm bench* > errorlog.txt");
+    r = system(cmd);
+    (void)r;
+}
+
+// resident set size of this process in bytes, 0 where unsupported
+uint64_t get_rss_bytes() {
+
+#if defined(__linux__)
+    long pages = 0, resident = 0;
+    FILE *fp = fopen("/proc/self/statm", "r");
+    if (!fp) {
+        return 0;
+    }
+    if (fscanf(fp, "%ld %ld", &pages, &resident) != 2) {
+        resident = 0;
+    }
+    fclose(fp);
+    return (uint64_t)resident * sysconf(_SC_PAGESIZE);
+#else
+    return 0;
+#endif
+}
+
+/*
+ * Sweep the number of kv stores sharing one file. The same total number
+ * of docs is spread over the kv stores so larger sweeps measure per-kvs
+ * overhead rather than more data. Reports open/close, set/get, full scan
+ * per kvs and commit latency, plus resident memory per open handle.
+ */
+void do_kvs_scaling_bench(const bench_opts_t *opts) {
+
+    static const int kvs_counts[] = {1, 16, 128, 1024, 4096};
+    const int n_counts = sizeof(kvs_counts) / sizeof(kvs_counts[0]);
+    const int total_docs = 65536;
+    const int commit_every = 4096;
+
+    int i, k, d, r, n_sets, n_open;
+    char cmd[64], dbname[64], title[64], keybuf[256], bodybuf[512];
+    fdb_status status;
+    fdb_file_handle *dbfile;
+    fdb_iterator *iterator;
+    fdb_doc *doc = NULL;
+    fdb_kvs_config kvs_config = fdb_get_default_kvs_config();
+    fdb_config fconfig = bench_config();
+
+    str_gen(bodybuf, 512);
+
+    for (i = 0; i < n_counts; ++i) {
+        int n_kvs = kvs_counts[i];
+        int docs_per_kvs = std::max(1, total_docs / n_kvs);
+        std::vector<fdb_kvs_handle*> db(n_kvs);
+
+        StatCollector *sa = new StatCollector(7, 1);
+        sa->t_stats[0][0].name.assign("kvs_open");
+        sa->t_stats[1][0].name.assign("kvs_set");
+        sa->t_stats[2][0].name.assign("kvs_commit");
+        sa->t_stats[3][0].name.assign("kvs_get");
+        sa->t_stats[4][0].name.assign("kvs_scan");
+        sa->t_stats[5][0].name.assign("kvs_close");
+        sa->t_stats[6][0].name.assign("file_close");
+
+        sprintf(cmd, "rm bench* > errorlog.txt");
+        r = system(cmd);
+
+        status = fdb_open(&dbfile, "bench0", &fconfig);
+        assert(status == FDB_RESULT_SUCCESS);
+
+        // stop at the first store that fails to open, the rest of the
+        // run and the sweep only cover the stores that did
+        uint64_t rss_before = get_rss_bytes();
+        for (n_open = 0; n_open < n_kvs; ++n_open) {
+            sprintf(dbname, "db%d", n_open);
+            if (!track_stat(&sa->t_stats[0][0],
+                            timed_fdb_kvs_open(dbfile, &db[n_open], dbname,
+                                               &kvs_config))) {
+                break;
+            }
+        }
+        uint64_t rss_after = get_rss_bytes();
+
+        n_sets = 0;
+        for (k = 0; k < n_open; ++k) {
+            for (d = 0; d < docs_per_kvs; ++d) {
+                sprintf(keybuf, "%dscalekey", d);
+                fdb_doc_create(&doc, keybuf, strlen(keybuf), NULL, 0,
+                               bodybuf, strlen(bodybuf));
+                track_stat(&sa->t_stats[1][0], timed_fdb_set(db[k], doc));
+                fdb_doc_free(doc);
+                if (++n_sets % commit_every == 0) {
+                    track_stat(&sa->t_stats[2][0],
+                               timed_fdb_commit(dbfile, false));
+                }
+            }
+        }
+        track_stat(&sa->t_stats[2][0], timed_fdb_commit(dbfile, true));
+
+        for (k = 0; k < n_open; ++k) {
+            for (d = 0; d < docs_per_kvs; ++d) {
+                sprintf(keybuf, "%dscalekey", d);
+                fdb_doc_create(&doc, keybuf, strlen(keybuf), NULL, 0,
+                               NULL, 0);
+                track_stat(&sa->t_stats[3][0], timed_fdb_get(db[k], doc));
+                fdb_doc_free(doc);
+            }
+        }
+
+        for (k = 0; k < n_open; ++k) {
+            ts_nsec start = get_monotonic_ts();
+            status = fdb_iterator_init(db[k], &iterator, NULL, 0, NULL, 0,
+                                       FDB_ITR_NONE);
+            if (status != FDB_RESULT_SUCCESS) {
+                continue;
+            }
+            do {
+                if (fdb_iterator_get(iterator, &doc) == FDB_RESULT_SUCCESS) {
+                    fdb_doc_free(doc);
+                    doc = NULL;
+                }
+            } while (fdb_iterator_next(iterator) == FDB_RESULT_SUCCESS);
+            fdb_iterator_close(iterator);
+            track_stat(&sa->t_stats[4][0], ts_diff(start, get_monotonic_ts()));
+        }
+
+        for (k = 0; k < n_open; ++k) {
+            track_stat(&sa->t_stats[5][0], timed_fdb_kvs_close(db[k]));
+        }
+        track_stat(&sa->t_stats[6][0], timed_fdb_close(dbfile));
+        fdb_shutdown();
+
+        sprintf(title, "KVS_SCALING-N%d", n_kvs);
+        printf("\n  %s: %d docs per kvs, %.02f KB resident per open "
+               "handle\n", title, docs_per_kvs,
+               rss_after > rss_before && n_open > 0 ?
+               (rss_after - rss_before) / 1024.0 / n_open : 0);
+        sa->aggregateAndPrintAll(title, n_open, "µs");
+        delete sa;
+
+        if (n_open < n_kvs) {
+            printf("\n  %s: only %d of %d kv stores opened, stopping the "
+                   "sweep\n", title, n_open, n_kvs);
+            break;
+        }
+    }
+
+    (void)opts;
+    (void)status;
+    sprintf(cmd, "rm bench* > errorlog.txt");
+    r = system(cmd);
+    (void)r;
+}
+
+/*
+ * Compare the lookup paths over one pre-loaded, WAL-flushed dataset:
+ * fdb_get by key against fdb_get_metaonly, fdb_get_metaonly_byseq,
+ * fdb_get_byseq and fdb_get_byoffset. A small buffer cache keeps most
+ * bodies on disk so the cheaper paths show how much I/O they avoid.
+ * Every path visits the docs in the same shuffled order.
+ */
+void do_lookup_bench(const bench_opts_t *opts) {
+
+    const int n_kvs = 4;
+    const int n_docs = 50000;
+    enum { L_GET, L_META, L_META_SEQ, L_SEQ, L_OFFSET, L_NUM };
+
+    int i, k, d, r, round;
+    char cmd[64], dbname[64], keybuf[256], metabuf[256], bodybuf[1024];
+    fdb_status status;
+    fdb_file_handle *dbfile;
+    fdb_kvs_handle *db[n_kvs];
+    fdb_doc *doc = NULL;
+    fdb_kvs_config kvs_config = fdb_get_default_kvs_config();
+    fdb_config fconfig = bench_config();
+    std::vector<fdb_seqnum_t> seqnums[n_kvs];
+    std::vector<uint64_t> offsets[n_kvs];
+    std::vector<int> order(n_docs);
+
+    fconfig.buffercache_size = 8 * 1024 * 1024;
+    str_gen(bodybuf, 1024);
+
+    sprintf(cmd, "rm bench* > errorlog.txt");
+    r = system(cmd);
+
+    status = fdb_open(&dbfile, "bench0", &fconfig);
+    assert(status == FDB_RESULT_SUCCESS);
+    for (k = 0; k < n_kvs; ++k) {
+        sprintf(dbname, "db%d", k);
+        status = fdb_kvs_open(dbfile, &db[k], dbname, &kvs_config);
+        assert(status == FDB_RESULT_SUCCESS);
+
+        for (d = 0; d < n_docs; ++d) {
+            sprintf(keybuf, "%dlookupkey", d);
+            sprintf(metabuf, "meta%d", d);
+            fdb_doc_create(&doc, keybuf, strlen(keybuf),
+                           metabuf, strlen(metabuf),
+                           bodybuf, strlen(bodybuf));
+            fdb_set(db[k], doc);
+            fdb_doc_free(doc);
+        }
+    }
+    status = fdb_commit(dbfile, FDB_COMMIT_MANUAL_WAL_FLUSH);
+    assert(status == FDB_RESULT_SUCCESS);
+
+    // seqnum and offset of every doc, for the byseq/byoffset paths
+    for (k = 0; k < n_kvs; ++k) {
+        seqnums[k].resize(n_docs);
+        offsets[k].resize(n_docs);
+        for (d = 0; d < n_docs; ++d) {
+            sprintf(keybuf, "%dlookupkey", d);
+            fdb_doc_create(&doc, keybuf, strlen(keybuf), NULL, 0, NULL, 0);
+            status = fdb_get_metaonly(db[k], doc);
+            assert(status == FDB_RESULT_SUCCESS);
+            seqnums[k][d] = doc->seqnum;
+            offsets[k][d] = doc->offset;
+            fdb_doc_free(doc);
+        }
+    }
+
+    for (d = 0; d < n_docs; ++d) {
+        order[d] = d;
+    }
+    srand(n_docs);
+    for (d = n_docs - 1; d > 0; --d) {
+        std::swap(order[d], order[rand() % (d + 1)]);
+    }
+
+    StatCollector *sa = new StatCollector(L_NUM, n_kvs);
+    for (k = 0; k < n_kvs; ++k) {
+        sa->t_stats[L_GET][k].name.assign("get");
+        sa->t_stats[L_META][k].name.assign("get_metaonly");
+        sa->t_stats[L_META_SEQ][k].name.assign("get_meta_byseq");
+        sa->t_stats[L_SEQ][k].name.assign("get_byseq");
+        sa->t_stats[L_OFFSET][k].name.assign("get_byoffset");
+    }
+
+    for (round = 0; round < opts->n_loops; ++round) {
+        for (i = 0; i < L_NUM; ++i) {
+            for (k = 0; k < n_kvs; ++k) {
+                stat_history_t *stat = &sa->t_stats[i][k];
+                for (d = 0; d < n_docs; ++d) {
+                    int n = order[d];
+                    if (i == L_GET || i == L_META) {
+                        sprintf(keybuf, "%dlookupkey", n);
+                        fdb_doc_create(&doc, keybuf, strlen(keybuf),
+                                       NULL, 0, NULL, 0);
+                    } else {
+                        fdb_doc_create(&doc, NULL, 0, NULL, 0, NULL, 0);
+                        doc->seqnum = seqnums[k][n];
+                        doc->offset = offsets[k][n];
+                    }
+
+                    switch (i) {
+                    case L_GET:
+                        track_stat(stat, timed_fdb_get(db[k], doc));
+                        break;
+                    case L_META:
+                        track_stat(stat, timed_fdb_get_metaonly(db[k], doc));
+                        break;
+                    case L_META_SEQ:
+                        track_stat(stat,
+                                   timed_fdb_get_metaonly_byseq(db[k], doc));
+                        break;
+                    case L_SEQ:
+                        track_stat(stat, timed_fdb_get_byseq(db[k], doc));
+                        break;
+                    case L_OFFSET:
+                        track_stat(stat, timed_fdb_get_byoffset(db[k], doc));
+                        break;
+                    }
+                    fdb_doc_free(doc);
+                }
+            }
+        }
+    }
+
+    sa->aggregateAndPrintAll("LOOKUP_PATHS", n_kvs, "µs");
+    delete sa;
+
+    for (k = 0; k < n_kvs; ++k) {
+        fdb_kvs_close(db[k]);
+    }
+    fdb_close(dbfile);
+    fdb_shutdown();
+
+    (void)status;
+    sprintf(cmd, "rm bench* > errorlog.txt");
+    r = system(cmd);
+    (void)r;
+}
+
+// docs/s of a full scan over kv
+double scan_rate(fdb_kvs_handle *kv) {
+
+    uint64_t n = 0;
+    fdb_iterator *iterator;
+    fdb_doc *doc = NULL;
+    ts_nsec start = get_monotonic_ts();
+
+    if (fdb_iterator_init(kv, &iterator, NULL, 0, NULL, 0,
+                          FDB_ITR_NO_DELETES) != FDB_RESULT_SUCCESS) {
+        return 0;
+    }
+    do {
+        if (fdb_iterator_get(iterator, &doc) == FDB_RESULT_SUCCESS) {
+            fdb_doc_free(doc);
+            doc = NULL;
+            n++;
+        }
+    } while (fdb_iterator_next(iterator) == FDB_RESULT_SUCCESS);
+    fdb_iterator_close(iterator);
+
+    double elapsed_s = ts_diff(start, get_monotonic_ts()) / 1e6;
+    return elapsed_s > 0 ? n / elapsed_s : 0;
+}
+
+/*
+ * File aging: sustained random updates and deletes over a fixed key
+ * space for aging_cycles full overwrites of the dataset, checkpointing
+ * scan throughput, random get latency, file size and stale block ratio
+ * after every cycle. Runs with block reuse on and off, each with and
+ * without a compaction between cycles.
+ */
+void do_aging_bench(const bench_opts_t *opts) {
+
+    static const struct {
+        const char *name;
+        uint64_t block_reusing_threshold;
+        bool compact;
+    } variants[] = {
+        {"REUSE",           65,  false},
+        {"REUSE-COMPACT",   65,  true},
+        {"NOREUSE",         100, false},
+        {"NOREUSE-COMPACT", 100, true},
+    };
+    const int n_variants = sizeof(variants) / sizeof(variants[0]);
+    const int n_docs = 100000;
+    const int n_gets = 10000;
+    const int commit_every = 1000;
+
+    int v, c, n, r;
+    char cmd[64], title[64], keybuf[256], bodybuf[512];
+    fdb_status status;
+    fdb_file_handle *dbfile;
+    fdb_kvs_handle *db;
+    fdb_file_info info;
+    fdb_doc *doc = NULL;
+    fdb_kvs_config kvs_config = fdb_get_default_kvs_config();
+
+    str_gen(bodybuf, 512);
+
+    for (v = 0; v < n_variants; ++v) {
+        fdb_config fconfig = bench_config();
+        fconfig.block_reusing_threshold = variants[v].block_reusing_threshold;
+
+        sprintf(cmd, "rm bench* > errorlog.txt");
+        r = system(cmd);
+
+        status = fdb_open(&dbfile, "bench0", &fconfig);
+        assert(status == FDB_RESULT_SUCCESS);
+        status = fdb_kvs_open(dbfile, &db, "db0", &kvs_config);
+        assert(status == FDB_RESULT_SUCCESS);
+
+        for (n = 0; n < n_docs; ++n) {
+            sprintf(keybuf, "%dagekey", n);
+            fdb_doc_create(&doc, keybuf, strlen(keybuf), NULL, 0,
+                           bodybuf, strlen(bodybuf));
+            fdb_set(db, doc);
+            fdb_doc_free(doc);
+        }
+        status = fdb_commit(dbfile, FDB_COMMIT_MANUAL_WAL_FLUSH);
+        assert(status == FDB_RESULT_SUCCESS);
+
+        sprintf(title, "AGING-%s", variants[v].name);
+        int printed = 0;
+        printf("\n========== File Aging (%s) - %d docs %n",
+               title, n_docs, &printed);
+        fillLineWith('=', 88 - printed);
+        printf("%-6s %12s %10s %10s %10s %8s %12s\n", "cycle",
+               "scan(doc/s)", "get p50", "get p99", "file(MB)", "stale%",
+               "compact(ms)");
+
+        srand(v + 1);
+        for (c = 0; c <= opts->aging_cycles; ++c) {
+            double compact_ms = 0;
+
+            // cycle 0 is the freshly loaded file
+            if (c > 0) {
+                for (n = 0; n < n_docs; ++n) {
+                    sprintf(keybuf, "%dagekey", rand() % n_docs);
+                    if (rand() % 10 == 0) {
+                        fdb_doc_create(&doc, keybuf, strlen(keybuf),
+                                       NULL, 0, NULL, 0);
+                        fdb_del(db, doc);
+                    } else {
+                        fdb_doc_create(&doc, keybuf, strlen(keybuf), NULL, 0,
+                                       bodybuf, strlen(bodybuf));
+                        fdb_set(db, doc);
+                    }
+                    fdb_doc_free(doc);
+                    if ((n + 1) % commit_every == 0) {
+                        fdb_commit(dbfile, FDB_COMMIT_NORMAL);
+                    }
+                }
+                fdb_commit(dbfile, FDB_COMMIT_MANUAL_WAL_FLUSH);
+                if (variants[v].compact) {
+                    ts_nsec lat = timed_fdb_compact(dbfile);
+                    compact_ms = (lat != ERR_NS) ? lat / 1e3 : -1;
+                }
+            }
+
+            StatCollector *sa = new StatCollector(1, 1);
+            for (n = 0; n < n_gets; ++n) {
+                sprintf(keybuf, "%dagekey", rand() % n_docs);
+                fdb_doc_create(&doc, keybuf, strlen(keybuf), NULL, 0,
+                               NULL, 0);
+                // deleted keys miss and are not tracked
+                track_stat(&sa->t_stats[0][0], timed_fdb_get(db, doc));
+                fdb_doc_free(doc);
+            }
+
+            double rate = scan_rate(db);
+            status = fdb_get_file_info(dbfile, &info);
+            assert(status == FDB_RESULT_SUCCESS);
+            printf("%-6d %12.0f %10.03f %10.03f %10.03f %8.02f %12.03f\n",
+                   c, rate, sa->percentile(0, 50), sa->percentile(0, 99),
+                   info.file_size / (1024.0 * 1024.0),
+                   info.file_size ?
+                   100.0 * (1.0 - (double)info.space_used / info.file_size)
+                   : 0, compact_ms);
+            delete sa;
+        }
+        fillLineWith('=', 87);
+
+        fdb_kvs_close(db);
+        fdb_close(dbfile);
+        fdb_shutdown();
+    }
+
+    (void)status;
+    sprintf(cmd, "rm bench* > errorlog.txt");
+    r = system(cmd);
+    (void)r;
+}
+
+/*
+ * Write docs_per_header updates between each of n_headers commits of a
+ * single kvs, recording the seqnum every commit header points at.
+ */
+void build_commit_history(fdb_file_handle *dbfile, fdb_kvs_handle *db,
+                          int n_headers, int docs_per_header,
+                          std::vector<fdb_seqnum_t> *seqnums) {
+
+    int h, d;
+    char keybuf[256], bodybuf[512];
+    fdb_doc *doc = NULL;
+    fdb_seqnum_t seqnum;
+    fdb_status status;
+
+    str_gen(bodybuf, 512);
+    seqnums->clear();
+    for (h = 0; h < n_headers; ++h) {
+        for (d = 0; d < docs_per_header; ++d) {
+            // half new keys, half updates of keys from earlier headers
+            sprintf(keybuf, "%dhistkey", (d % 2) ? h * docs_per_header + d :
+                    (rand() % (h + 1)) * docs_per_header + 1);
+            fdb_doc_create(&doc, keybuf, strlen(keybuf), NULL, 0,
+                           bodybuf, strlen(bodybuf));
+            fdb_set(db, doc);
+            fdb_doc_free(doc);
+        }
+        status = fdb_commit(dbfile, FDB_COMMIT_NORMAL);
+        assert(status == FDB_RESULT_SUCCESS);
+        status = fdb_get_kvs_seqnum(db, &seqnum);
+        assert(status == FDB_RESULT_SUCCESS);
+        seqnums->push_back(seqnum);
+    }
+    (void)status;
+}
+
+fdb_changes_decision count_changes(fdb_kvs_handle *handle, fdb_doc *doc,
+                                   void *ctx) {
+
+    (*(uint64_t*)ctx)++;
+    (void)handle;
+    (void)doc;
+    return FDB_CHANGES_CLEAN;
+}
+
+/*
+ * Rollback and sequence history: build a file with many commit headers,
+ * then time fdb_changes_since from, and fdb_rollback to, the header a
+ * given number of commits back. Rollback discards the later headers, so
+ * every distance runs on a fresh copy of the history built for the
+ * trial. Two history sizes show how both scale with the file size.
+ */
+void do_rollback_bench(const bench_opts_t *opts) {
+
+    static const int distances[] = {1, 8, 64, 256, 511};
+    static const int history_docs[] = {200, 2000};     // docs per header
+    const int n_distances = sizeof(distances) / sizeof(distances[0]);
+    const int n_sizes = sizeof(history_docs) / sizeof(history_docs[0]);
+    const int n_headers = 512;
+    const int n_trials = 3;
+
+    int i, j, t, r;
+    char cmd[64];
+    fdb_status status;
+    fdb_file_handle *dbfile;
+    fdb_kvs_handle *db;
+    fdb_file_info info;
+    fdb_kvs_config kvs_config = fdb_get_default_kvs_config();
+    fdb_config fconfig = bench_config();
+    std::vector<fdb_seqnum_t> seqnums;
+
+    // keep every header we build reachable for rollback
+    fconfig.num_keeping_headers = n_headers + 1;
+
+    int printed = 0;
+    printf("\n========== Rollback (ROLLBACK) - %d headers %n", n_headers,
+           &printed);
+    fillLineWith('=', 88 - printed);
+    printf("%-9s %-9s %10s %10s %13s %13s %10s %12s\n", "docs/hdr",
+           "headers", "seqs back", "file(MB)", "rollback(ms)", "changes(ms)",
+           "changes", "µs/change");
+
+    for (j = 0; j < n_sizes; ++j) {
+        int docs_per_header = history_docs[j];
+        uint64_t file_size = 0;
+        std::vector<uint64_t> n_changes(n_distances);
+        std::vector<uint64_t> seqs_back(n_distances);
+        std::vector<StatCollector*> sa(n_distances);
+        for (i = 0; i < n_distances; ++i) {
+            sa[i] = new StatCollector(2, 1);
+        }
+
+        for (t = 0; t < n_trials; ++t) {
+            sprintf(cmd, "rm bench* > errorlog.txt");
+            r = system(cmd);
+
+            status = fdb_open(&dbfile, "bench_history", &fconfig);
+            assert(status == FDB_RESULT_SUCCESS);
+            status = fdb_kvs_open(dbfile, &db, "db0", &kvs_config);
+            assert(status == FDB_RESULT_SUCCESS);
+
+            srand(t + 1);
+            build_commit_history(dbfile, db, n_headers, docs_per_header,
+                                 &seqnums);
+            status = fdb_get_file_info(dbfile, &info);
+            assert(status == FDB_RESULT_SUCCESS);
+            file_size = info.file_size;
+            fdb_kvs_close(db);
+            fdb_close(dbfile);
+
+            for (i = 0; i < n_distances; ++i) {
+                sprintf(cmd, "cp bench_history bench0");
+                r = system(cmd);
+
+                status = fdb_open(&dbfile, "bench0", &fconfig);
+                assert(status == FDB_RESULT_SUCCESS);
+                status = fdb_kvs_open(dbfile, &db, "db0", &kvs_config);
+                assert(status == FDB_RESULT_SUCCESS);
+
+                fdb_seqnum_t target = seqnums[n_headers - 1 - distances[i]];
+                seqs_back[i] = seqnums[n_headers - 1] - target;
+
+                n_changes[i] = 0;
+                track_stat(&sa[i]->t_stats[1][0],
+                           timed_fdb_changes_since(db, target + 1,
+                                                   count_changes,
+                                                   &n_changes[i]));
+                track_stat(&sa[i]->t_stats[0][0],
+                           timed_fdb_rollback(&db, target));
+
+                fdb_kvs_close(db);
+                fdb_close(dbfile);
+            }
+        }
+
+        for (i = 0; i < n_distances; ++i) {
+            double changes_us = sa[i]->percentile(1, 50);
+            printf("%-9d %-9d %10llu %10.03f %13.03f %13.03f %10llu "
+                   "%12.03f\n", docs_per_header, distances[i],
+                   (unsigned long long)seqs_back[i],
+                   file_size / (1024.0 * 1024.0),
+                   sa[i]->percentile(0, 50) / 1e3, changes_us / 1e3,
+                   (unsigned long long)n_changes[i],
+                   n_changes[i] ? changes_us / n_changes[i] : 0);
+            delete sa[i];
+        }
+    }
+    fillLineWith('=', 87);
+    fdb_shutdown();
+
+    (void)opts;
+    (void)status;
+    sprintf(cmd, "rm bench* > errorlog.txt");
+    r = system(cmd);
+    (void)r;
+}
+
+/*
+ * Price at-rest encryption and document body compression: load, random
+ * get and full scan with each on and off, over value bodies of varying
+ * compressibility. CPU time per op is process-wide, so it includes
+ * forestdb's own threads; scan cpu is per doc visited. Combinations this
+ * forestdb build lacks (no snappy or no AES support) are skipped.
+ */
+void do_codec_bench(const bench_opts_t *opts) {
+
+    const int n_docs = 20000;
+    const int n_gets = 20000;
+    const int body_len = 4096;
+    const int pool_size = 256;  // distinct bodies per value kind
+
+    int e, c, k, n, r;
+    char cmd[64], keybuf[256];
+    std::vector<std::vector<char> > pool(VALUE_NUM_KINDS);
+    fdb_status status;
+    fdb_file_handle *dbfile;
+    fdb_kvs_handle *db;
+    fdb_file_info info;
+    fdb_doc *doc = NULL;
+
+    int printed = 0;
+    printf("\n========== Encryption / Compression (CODEC) - %d docs of %d "
+           "bytes %n", n_docs, body_len, &printed);
+    fillLineWith('=', 88 - printed);
+    printf("%-22s %10s %9s %9s %9s %9s %11s %9s %9s %9s %9s\n", "config",
+           "set/s", "set p50", "get p50", "get p95", "get p99", "scan doc/s",
+           "cpu/set", "cpu/get", "cpu/scan", "disk(MB)");
+
+    // bodies are generated up front so generator cost, which differs by
+    // kind, stays out of the timed and cpu-accounted windows
+    for (k = 0; k < VALUE_NUM_KINDS; ++k) {
+        unsigned int seed = k + 1;
+        pool[k].resize((size_t)pool_size * body_len);
+        for (n = 0; n < pool_size; ++n) {
+            value_gen(&pool[k][(size_t)n * body_len], body_len, k, &seed);
+        }
+    }
+
+    for (e = 0; e < 2; ++e) {
+        for (c = 0; c < 2; ++c) {
+            bench_profile_t profile;
+            profile.name = "codec";
+            profile.fconfig = bench_config();
+            profile.kvs_config = fdb_get_default_kvs_config();
+            profile.fconfig.compress_document_body = c;
+            if (e) {
+                profile.fconfig.encryption_key.algorithm =
+                    FDB_ENCRYPTION_AES256;
+                memset(profile.fconfig.encryption_key.bytes, 0x5a,
+                       sizeof(profile.fconfig.encryption_key.bytes));
+            }
+            if (!profile_supported(&profile)) {
+                printf("%s%s: not supported by this build\n",
+                       e ? "aes256" : "plain", c ? "+snappy" : "");
+                continue;
+            }
+
+            for (k = 0; k < VALUE_NUM_KINDS; ++k) {
+                char label[64];
+                StatCollector *sa = new StatCollector(2, 1);
+
+                sprintf(label, "%s%s/%s", e ? "aes256" : "plain",
+                        c ? "+snappy" : "", value_kind_names[k]);
+                sprintf(cmd, "rm bench* > errorlog.txt");
+                r = system(cmd);
+
+                status = fdb_open(&dbfile, "bench0", &profile.fconfig);
+                assert(status == FDB_RESULT_SUCCESS);
+                status = fdb_kvs_open(dbfile, &db, "db0",
+                                      &profile.kvs_config);
+                assert(status == FDB_RESULT_SUCCESS);
+
+                ts_nsec start = get_monotonic_ts();
+                ts_nsec cpu_start = get_cpu_ts();
+                for (n = 0; n < n_docs; ++n) {
+                    const char *body =
+                        &pool[k][(size_t)(n % pool_size) * body_len];
+                    sprintf(keybuf, "%dcodeckey", n);
+                    fdb_doc_create(&doc, keybuf, strlen(keybuf), NULL, 0,
+                                   body, body_len);
+                    track_stat(&sa->t_stats[0][0], timed_fdb_set(db, doc));
+                    fdb_doc_free(doc);
+                }
+                status = fdb_commit(dbfile, FDB_COMMIT_MANUAL_WAL_FLUSH);
+                assert(status == FDB_RESULT_SUCCESS);
+                double load_s = ts_diff(start, get_monotonic_ts()) / 1e6;
+                double cpu_set_us = (get_cpu_ts() - cpu_start) / 1e3 / n_docs;
+
+                srand(n_docs);
+                cpu_start = get_cpu_ts();
+                for (n = 0; n < n_gets; ++n) {
+                    sprintf(keybuf, "%dcodeckey", rand() % n_docs);
+                    fdb_doc_create(&doc, keybuf, strlen(keybuf), NULL, 0,
+                                   NULL, 0);
+                    track_stat(&sa->t_stats[1][0], timed_fdb_get(db, doc));
+                    fdb_doc_free(doc);
+                }
+                double cpu_get_us = (get_cpu_ts() - cpu_start) / 1e3 / n_gets;
+
+                cpu_start = get_cpu_ts();
+                double rate = scan_rate(db);
+                double cpu_scan_us = (get_cpu_ts() - cpu_start) / 1e3 / n_docs;
+                status = fdb_get_file_info(dbfile, &info);
+                assert(status == FDB_RESULT_SUCCESS);
+
+                printf("%-22s %10.0f %9.03f %9.03f %9.03f %9.03f %11.0f "
+                       "%9.03f %9.03f %9.03f %9.03f\n", label,
+                       load_s > 0 ? n_docs / load_s : 0,
+                       sa->percentile(0, 50), sa->percentile(1, 50),
+                       sa->percentile(1, 95), sa->percentile(1, 99), rate,
+                       cpu_set_us, cpu_get_us, cpu_scan_us,
+                       info.file_size / (1024.0 * 1024.0));
+                delete sa;
+
+                fdb_kvs_close(db);
+                fdb_close(dbfile);
+                fdb_shutdown();
+            }
+        }
+    }
+    fillLineWith('=', 87);
+
+    (void)opts;
+    (void)status;
+    sprintf(cmd, "rm bench* > errorlog.txt");
+    r = system(cmd);
+    (void)r;
+}
+
+#if !defined(WIN32) && !defined(_WIN32)
+// what the multiproc workers time, one shared histogram each
+enum {
+    MP_READ,            // fdb_get in reader processes
+    MP_ITER,            // snapshot iterator get + next
+    MP_REOPEN,          // reopen to pick up the writer's latest header
+    MP_WRITE,           // fdb_set in the writer
+    MP_COMMIT,          // fdb_commit with the exclusive lock held
+    MP_LOCK_SH,         // wait for the shared file lock (readers)
+    MP_LOCK_EX,         // wait for the exclusive file lock (writer)
+    MP_NUM_KINDS
+};
+
+static const char *mp_kind_names[] = {
+    "read", "iter_next", "reopen", "write", "commit", "lock_sh_wait",
+    "lock_ex_wait"
+};
+
+// log-linear buckets: exact below 8µs, then 8 sub-buckets per power of 2
+static const int MP_BUCKETS = 512;
+
+// Lives in a MAP_SHARED mapping created before fork(), so every worker
+// records into it directly and the parent reads it once they exit.
+struct mp_shared {
+    std::atomic<uint64_t> counts[MP_NUM_KINDS][MP_BUCKETS];
+    std::atomic<uint64_t> total_us[MP_NUM_KINDS];
+    std::atomic<uint64_t> max_us[MP_NUM_KINDS];
+    std::atomic<uint64_t> errors[MP_NUM_KINDS];
+    std::atomic<bool> stop;
+};
+
+static int mp_bucket(uint64_t v) {
+
+    int e = 63;
+    if (v < 8) {
+        return (int)v;
+    }
+    while (!(v >> e)) {
+        e--;
+    }
+    return (e - 2) * 8 + (int)((v >> (e - 3)) & 7);
+}
+
+// lowest value that falls into bucket b
+static uint64_t mp_bucket_value(int b) {
+
+    if (b < 8) {
+        return b;
+    }
+    return (uint64_t)(8 + b % 8) << (b / 8 - 1);
+}
+
+static void mp_record(mp_shared *sh, int kind, ts_nsec lat) {
+
+    if (lat == ERR_NS) {
+        sh->errors[kind]++;
+        return;
+    }
+    sh->counts[kind][mp_bucket(lat)]++;
+    sh->total_us[kind] += lat;
+    uint64_t prev = sh->max_us[kind];
+    while (prev < (uint64_t)lat &&
+           !sh->max_us[kind].compare_exchange_weak(prev, lat)) {
+    }
+}
+
+static uint64_t mp_count(mp_shared *sh, int kind) {
+
+    uint64_t n = 0;
+    for (int b = 0; b < MP_BUCKETS; ++b) {
+        n += sh->counts[kind][b];
+    }
+    return n;
+}
+
+static uint64_t mp_percentile(mp_shared *sh, int kind, int pct) {
+
+    uint64_t n = mp_count(sh, kind), seen = 0;
+    uint64_t rank = n * pct / 100;
+    for (int b = 0; b < MP_BUCKETS; ++b) {
+        seen += sh->counts[kind][b];
+        if (seen > rank) {
+            return mp_bucket_value(b);
+        }
+    }
+    return 0;
+}
+
+static ts_nsec mp_lock(int fd, int op) {
+
+    ts_nsec start = get_monotonic_ts();
+    while (flock(fd, op) != 0) {
+        if (errno != EINTR) {
+            return ERR_NS;
+        }
+    }
+    return ts_diff(start, get_monotonic_ts());
+}
+
+enum {
+    MP_ROLE_WRITER,
+    MP_ROLE_READER,
+    MP_ROLE_ITERATOR
+};
+
+struct mp_worker {
+    int role;
+    int n_files;
+    int n_docs;
+    int lock_fd;
+    fdb_config *fconfig;
+    fdb_kvs_config *kvs_config;
+    fdb_file_handle **dbfile;
+    fdb_kvs_handle **db;
+    mp_shared *sh;
+};
+
+// (re)open every file under the shared lock so the view is a committed
+// header; the reopen is what lets a reader see another process' commits
+static bool mp_open_all(mp_worker *w, bool reopen) {
+
+    ts_nsec lat = 0;
+    bool ok = true;
+
+    mp_record(w->sh, MP_LOCK_SH, mp_lock(w->lock_fd, LOCK_SH));
+    for (int f = 0; f < w->n_files && ok; ++f) {
+        char fname[64];
+        ts_nsec l1, l2;
+
+        if (reopen) {
+            fdb_kvs_close(w->db[f]);
+            fdb_close(w->dbfile[f]);
+        }
+        sprintf(fname, "bench%d", f);
+        l1 = timed_fdb_open(&w->dbfile[f], fname, w->fconfig);
+        l2 = (l1 == ERR_NS) ? ERR_NS :
+             timed_fdb_kvs_open(w->dbfile[f], &w->db[f], "db0", w->kvs_config);
+        ok = (l2 != ERR_NS);
+        lat = ok ? lat + l1 + l2 : ERR_NS;
+    }
+    flock(w->lock_fd, LOCK_UN);
+    if (reopen || !ok) {
+        mp_record(w->sh, MP_REOPEN, lat);
+    }
+    return ok;
+}
+
+static void mp_writer(mp_worker *w) {
+
+    const int batch = 100;
+    char keybuf[64], bodybuf[512];
+    fdb_doc *doc;
+    std::vector<bool> dirty(w->n_files);
+
+    str_gen(bodybuf, sizeof(bodybuf));
+    srand(getpid());
+    while (!w->sh->stop) {
+        for (int n = 0; n < batch; ++n) {
+            int f = rand() % w->n_files;
+            sprintf(keybuf, "%dmpkey", rand() % w->n_docs);
+            fdb_doc_create(&doc, keybuf, strlen(keybuf), NULL, 0,
+                           bodybuf, sizeof(bodybuf));
+            mp_record(w->sh, MP_WRITE, timed_fdb_set(w->db[f], doc));
+            fdb_doc_free(doc);
+            dirty[f] = true;
+        }
+        mp_record(w->sh, MP_LOCK_EX, mp_lock(w->lock_fd, LOCK_EX));
+        for (int f = 0; f < w->n_files; ++f) {
+            if (dirty[f]) {
+                mp_record(w->sh, MP_COMMIT,
+                          timed_fdb_commit(w->dbfile[f], true));
+                dirty[f] = false;
+            }
+        }
+        flock(w->lock_fd, LOCK_UN);
+    }
+}
+
+static void mp_reader(mp_worker *w) {
+
+    const ts_nsec refresh_us = 50000;
+    char keybuf[64];
+    fdb_doc *doc;
+    ts_nsec last = get_monotonic_ts();
+
+    srand(getpid());
+    while (!w->sh->stop) {
+        if (ts_diff(last, get_monotonic_ts()) >= refresh_us) {
+            if (!mp_open_all(w, true)) {
+                // handles are half closed, let the parent count it
+                _exit(1);
+            }
+            last = get_monotonic_ts();
+        }
+
+        int f = rand() % w->n_files;
+        if (w->role == MP_ROLE_READER) {
+            sprintf(keybuf, "%dmpkey", rand() % w->n_docs);
+            fdb_doc_create(&doc, keybuf, strlen(keybuf), NULL, 0, NULL, 0);
+            mp_record(w->sh, MP_READ, timed_fdb_get(w->db[f], doc));
+            fdb_doc_free(doc);
+            continue;
+        }
+
+        // iterator: walk a stretch of a snapshot of the current view
+        fdb_kvs_handle *snap;
+        fdb_iterator *it;
+        if (timed_fdb_snapshot(w->db[f], &snap) == ERR_NS) {
+            mp_record(w->sh, MP_ITER, ERR_NS);
+            continue;
+        }
+        if (timed_fdb_iterator_init(snap, &it, FDB_ITR_NONE) != ERR_NS) {
+            for (int n = 0; n < 100 && !w->sh->stop; ++n) {
+                doc = NULL;
+                ts_nsec l1 = timed_fdb_iterator_get(it, &doc);
+                if (l1 == ERR_NS) {
+                    break;
+                }
+                fdb_doc_free(doc);
+                ts_nsec l2 = timed_fdb_iterator_next(it);
+                if (l2 == ERR_NS) {
+                    break;
+                }
+                mp_record(w->sh, MP_ITER, l1 + l2);
+            }
+            fdb_iterator_close(it);
+        } else {
+            mp_record(w->sh, MP_ITER, ERR_NS);
+        }
+        fdb_kvs_close(snap);
+    }
+}
+#endif
+
+/*
+ * Multi-process shared-file access: procs worker processes open the same
+ * bench%d files, one writing and committing while the rest run point
+ * reads or snapshot iterators on read-only handles; block reuse is off
+ * for the whole run. forestdb has no cross-process locking of its own,
+ * so workers coordinate through flock() on a lock file, the writer
+ * holding it exclusively across commits and readers holding it shared
+ * while they reopen to pick up the new header. All latencies land in a
+ * histogram shared by mmap(MAP_SHARED) and are reported by the parent.
+ */
+void do_multiproc_bench(const bench_opts_t *opts) {
+
+#if !defined(WIN32) && !defined(_WIN32)
+    const int n_files = 2;
+    const int n_docs = 10000;
+    const int duration_ms = 5000;
+    const int n_procs = opts->mp_procs;
+
+    int f, k, n, r;
+    int failed = 0;
+    char cmd[64], fname[64], keybuf[64], bodybuf[512];
+    fdb_status status;
+    fdb_doc *doc;
+    fdb_config fconfig = bench_config();
+    fdb_config rconfig;
+    fdb_kvs_config kvs_config = fdb_get_default_kvs_config();
+    std::vector<fdb_file_handle*> dbfile(n_files);
+    std::vector<fdb_kvs_handle*> db(n_files);
+    std::vector<pid_t> pids;
+
+    // forestdb only guards blocks still referenced by readers of its own
+    // process, so the writer must not reuse blocks a stale header or an
+    // open snapshot in another process may point at
+    fconfig.block_reusing_threshold = 0;
+    rconfig = fconfig;
+    rconfig.flags = FDB_OPEN_FLAG_RDONLY;
+
+    sprintf(cmd, "rm bench* > errorlog.txt");
+    r = system(cmd);
+
+    mp_shared *sh = (mp_shared*)mmap(NULL, sizeof(mp_shared),
+                                     PROT_READ | PROT_WRITE,
+                                     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    assert(sh != MAP_FAILED);
+    assert(sh->stop.is_lock_free() && sh->max_us[0].is_lock_free());
+    // flock() locks belong to the open file description, so the parent
+    // only creates the lock file; each worker opens its own after fork()
+    int lock_fd = open("bench_mp.lock", O_CREAT | O_RDWR, 0644);
+    assert(lock_fd >= 0);
+    close(lock_fd);
+
+    // preload every file, then drop all forestdb state before forking
+    str_gen(bodybuf, sizeof(bodybuf));
+    for (f = 0; f < n_files; ++f) {
+        sprintf(fname, "bench%d", f);
+        status = fdb_open(&dbfile[f], fname, &fconfig);
+        assert(status == FDB_RESULT_SUCCESS);
+        status = fdb_kvs_open(dbfile[f], &db[f], "db0", &kvs_config);
+        assert(status == FDB_RESULT_SUCCESS);
+        for (n = 0; n < n_docs; ++n) {
+            sprintf(keybuf, "%dmpkey", n);
+            fdb_doc_create(&doc, keybuf, strlen(keybuf), NULL, 0,
+                           bodybuf, sizeof(bodybuf));
+            status = fdb_set(db[f], doc);
+            assert(status == FDB_RESULT_SUCCESS);
+            fdb_doc_free(doc);
+        }
+        status = fdb_commit(dbfile[f], FDB_COMMIT_MANUAL_WAL_FLUSH);
+        assert(status == FDB_RESULT_SUCCESS);
+        fdb_kvs_close(db[f]);
+        fdb_close(dbfile[f]);
+    }
+    fdb_shutdown();
+
+    // worker 0 writes, the rest alternate point readers and iterators
+    fflush(stdout);
+    for (k = 0; k < n_procs; ++k) {
+        pid_t pid = fork();
+        assert(pid >= 0);
+        if (pid == 0) {
+            mp_worker w;
+            w.role = (k == 0) ? MP_ROLE_WRITER :
+                     (k % 2) ? MP_ROLE_READER : MP_ROLE_ITERATOR;
+            w.n_files = n_files;
+            w.n_docs = n_docs;
+            w.lock_fd = open("bench_mp.lock", O_RDWR);
+            if (w.lock_fd < 0) {
+                _exit(1);
+            }
+            w.fconfig = (w.role == MP_ROLE_WRITER) ? &fconfig : &rconfig;
+            w.kvs_config = &kvs_config;
+            w.dbfile = dbfile.data();
+            w.db = db.data();
+            w.sh = sh;
+            if (!mp_open_all(&w, false)) {
+                _exit(1);
+            }
+            if (w.role == MP_ROLE_WRITER) {
+                mp_writer(&w);
+            } else {
+                mp_reader(&w);
+            }
+            for (f = 0; f < n_files; ++f) {
+                fdb_kvs_close(db[f]);
+                fdb_close(dbfile[f]);
+            }
+            fdb_shutdown();
+            close(w.lock_fd);
+            _exit(0);
+        }
+        pids.push_back(pid);
+    }
+
+    usleep(duration_ms * 1000);
+    sh->stop = true;
+    for (k = 0; k < n_procs; ++k) {
+        int wstatus;
+        waitpid(pids[k], &wstatus, 0);
+        if (!WIFEXITED(wstatus) || WEXITSTATUS(wstatus) != 0) {
+            failed++;
+        }
+    }
+
+    int printed = 0;
+    printf("\n========== Multi-process shared files (MULTIPROC) - %d procs, "
+           "%d files (µs) %n", n_procs, n_files, &printed);
+    fillLineWith('=', 88 - printed);
+    printf("%-16s %10s %8s %10s %10s %10s %10s %10s\n", "op", "count",
+           "errors", "mean", "p50", "p95", "p99", "max");
+    for (k = 0; k < MP_NUM_KINDS; ++k) {
+        uint64_t count = mp_count(sh, k);
+        printf("%-16s %10llu %8llu %10.01f %10llu %10llu %10llu %10llu\n",
+               mp_kind_names[k], (unsigned long long)count,
+               (unsigned long long)sh->errors[k].load(),
+               count ? (double)sh->total_us[k] / count : 0.0,
+               (unsigned long long)mp_percentile(sh, k, 50),
+               (unsigned long long)mp_percentile(sh, k, 95),
+               (unsigned long long)mp_percentile(sh, k, 99),
+               (unsigned long long)sh->max_us[k].load());
+    }
+    // share of each side's wall time spent blocked on the file lock
+    int n_readers = n_procs - 1;
+    printf("\nlock contention: readers %.02f%% of time waiting for the "
+           "shared lock, writer %.02f%% for the exclusive lock\n",
+           n_readers > 0 ? sh->total_us[MP_LOCK_SH] * 100.0 /
+                           (n_readers * duration_ms * 1e3) : 0.0,
+           sh->total_us[MP_LOCK_EX] * 100.0 / (duration_ms * 1e3));
+    if (failed) {
+        printf("%d/%d worker processes failed\n", failed, n_procs);
+    }
+    fillLineWith('=', 87);
+
+    munmap(sh, sizeof(mp_shared));
+    (void)status;
+    sprintf(cmd, "rm bench* > errorlog.txt");
+    r = system(cmd);
+    (void)r;
+#else
+    printf("\nmultiproc benchmark requires fork(), skipping\n");
+    (void)opts;
+#endif
+}
+
+void usage(const char *prog) {
+
+    printf("usage: %s [options] [scenario ...]\n"
+           "scenarios:\n"
+           "  iterator           write/read/snapshot iterator loops "
+           "(default)\n"
+           "  recovery           reopen latency after an unclean "
+           "shutdown\n"
+           "  replay             re-issue the trace given with "
+           "--replay\n"
+           "  matrix             iterator benchmark once per config "
+           "profile, compared\n"
+           "  bgflush            set/commit/WAL flush latency across "
+           "bgflusher threads\n"
+           "                     and wal_threshold\n"
+           "  groupcommit        client threads batched into shared "
+           "commits\n"
+           "  kvscale            1 to 4096 kv stores per file\n"
+           "  lookup             fdb_get vs metaonly, byseq and "
+           "byoffset lookups\n"
+           "  aging              scan/get decay under sustained "
+           "update/delete churn\n"
+           "  rollback           fdb_rollback and fdb_changes_since vs "
+           "history distance\n"
+           "  codec              encryption and compression overhead "
+           "by value type\n"
+           "  multiproc          writer, readers and iterators in "
+           "separate processes\n"
+           "                     sharing the same files\n"
+           "  all                every scenario above\n"
+           "options:\n"
+           "  --loops N          measured loops, minimum when converging "
+           "(default 5)\n"
+           "  --max-loops N      cap on warmup loops and on measured loops "
+           "(default 50)\n"
+           "  --warmup-ops N     discard loops until N ops were tracked\n"
+           "  --warmup-ms N      discard loops until N ms have elapsed\n"
+           "  --steady-cv X      discard loops until the rolling cv of "
+           "per-loop medians <= X\n"
+           "  --steady-window N  loops in the rolling cv window "
+           "(default 3)\n"
+           "  --converge-tol X   extend run until p50/p95/p99 move < X "
+           "between loops\n"
+           "  --attribution      per-phase client vs engine latency "
+           "split (iterator)\n"
+           "  --record FILE      record set/get/delete/commit ops of the "
+           "iterator and\n"
+           "                     matrix scenarios to a trace\n"
+           "  --replay FILE      replay a recorded trace (adds the replay "
+           "scenario)\n"
+           "  --replay-threads N replay threads, files split between them "
+           "(default 1)\n"
+           "  --replay-speed X   0 replays as fast as possible, otherwise "
+           "follow trace\n"
+           "                     timestamps at X times the recorded rate "
+           "(default 0)\n"
+           "  --aging-cycles N   dataset overwrite cycles for aging "
+           "(default 5)\n"
+           "  --procs N          worker processes for multiproc, "
+           "one of them the writer\n"
+           "                     (default 4)\n"
+           "  --profiles LIST    comma separated profiles for matrix "
+           "(default all, or\n"
+           "                     only --profile ones if given). Presets:\n"
+           "                     default, bcache_32m, bcache_1g, wal_64k, "
+           "seqtree_off,\n"
+           "                     block_reuse_off, compress, bgflush_2, "
+           "custom_cmp\n"
+           "  --profile DEF      define a matrix profile (adds the matrix "
+           "scenario), DEF is\n"
+           "                     name:key=value,... with keys base "
+           "(a preset),\n"
+           "                     buffercache_size, wal_threshold, "
+           "wal_partitions,\n"
+           "                     bcache_partitions, seqtree, "
+           "block_reusing_threshold,\n"
+           "                     num_keeping_headers, compress, "
+           "bgflushers, compactors,\n"
+           "                     custom_cmp; sizes take k/m/g, "
+           "may be repeated\n",
+           prog);
+}
+
+static const struct {
+    const char *name;
+    uint32_t flag;
+} scenario_names[] = {
+    {"iterator",    SCENARIO_ITERATOR},
+    {"recovery",    SCENARIO_RECOVERY},
+    {"replay",      SCENARIO_REPLAY},
+    {"matrix",      SCENARIO_MATRIX},
+    {"bgflush",     SCENARIO_BGFLUSH},
+    {"groupcommit", SCENARIO_GROUP_COMMIT},
+    {"kvscale",     SCENARIO_KVS_SCALING},
+    {"lookup",      SCENARIO_LOOKUP},
+    {"aging",       SCENARIO_AGING},
+    {"rollback",    SCENARIO_ROLLBACK},
+    {"codec",       SCENARIO_CODEC},
+    {"multiproc",   SCENARIO_MULTIPROC},
+    {"all",         0xFFFFFFFF},
+};
+
+bool parse_scenario(bench_opts_t *opts, const char *arg) {
+
+    size_t i;
+    for (i = 0; i < sizeof(scenario_names) / sizeof(scenario_names[0]); ++i) {
+        if (!strcmp(arg, scenario_names[i].name)) {
+            opts->scenarios |= scenario_names[i].flag;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool parse_bench_opts(bench_opts_t *opts, int argc, char* args[]) {
+
+    int i;
+
+    opts->scenarios = 0;
+    opts->n_loops = 5;
+    opts->max_loops = 50;
+    opts->warmup_ops = 0;
+    opts->warmup_ms = 0;
+    opts->steady_cv = 0;
+    opts->steady_window = 3;
+    opts->converge_tol = 0;
+    opts->record_path = NULL;
+    opts->replay_path = NULL;
+    opts->replay_threads = 1;
+    opts->replay_speed = 0;
+    opts->profiles = NULL;
+    opts->custom_profiles.clear();
+    opts->aging_cycles = 5;
+    opts->mp_procs = 4;
+    opts->attribution = false;
+
+    for (i = 1; i < argc; ++i) {
+        const char *arg = args[i];
+        const char *val = (i + 1 < argc) ? args[i + 1] : NULL;
+
+        if (strncmp(arg, "--", 2)) {
+            if (!parse_scenario(opts, arg)) {
+                return false;
+            }
+            continue;
+        } else if (!strcmp(arg, "--attribution")) {
+            opts->attribution = true;
+            continue;
+        } else if (!val) {
+            return false;
+        } else if (!strcmp(arg, "--loops")) {
+            opts->n_loops = atoi(val);
+        } else if (!strcmp(arg, "--max-loops")) {
+            opts->max_loops = atoi(val);
+        } else if (!strcmp(arg, "--warmup-ops")) {
+            opts->warmup_ops = strtoull(val, NULL, 10);
+        } else if (!strcmp(arg, "--warmup-ms")) {
+            opts->warmup_ms = strtoull(val, NULL, 10);
+        } else if (!strcmp(arg, "--steady-cv")) {
+            opts->steady_cv = atof(val);
+        } else if (!strcmp(arg, "--steady-window")) {
+            opts->steady_window = atoi(val);
+        } else if (!strcmp(arg, "--converge-tol")) {
+            opts->converge_tol = atof(val);
+        } else if (!strcmp(arg, "--record")) {
+            opts->record_path = val;
+        } else if (!strcmp(arg, "--replay")) {
+            opts->replay_path = val;
+            opts->scenarios |= SCENARIO_REPLAY;
+        } else if (!strcmp(arg, "--replay-threads")) {
+            opts->replay_threads = atoi(val);
+        } else if (!strcmp(arg, "--replay-speed")) {
+            opts->replay_speed = atof(val);
+        } else if (!strcmp(arg, "--profiles")) {
+            opts->profiles = val;
+        } else if (!strcmp(arg, "--profile")) {
+            bench_profile_t profile;
+            if (!parse_profile(val, &profile)) {
+                return false;
+            }
+            opts->custom_profiles.push_back(profile);
+            opts->scenarios |= SCENARIO_MATRIX;
+        } else if (!strcmp(arg, "--aging-cycles")) {
+            opts->aging_cycles = atoi(val);
+        } else if (!strcmp(arg, "--procs")) {
+            opts->mp_procs = atoi(val);
+        } else {
+            return false;
+        }
+        i++;
+    }
+
+    if (!opts->scenarios) {
+        opts->scenarios = SCENARIO_ITERATOR;
+    }
+    if (!opts->replay_path) {
+        opts->scenarios &= ~SCENARIO_REPLAY;
+    }
+    // only the iterator loops (also run by matrix) are instrumented
+    if (opts->record_path &&
+        !(opts->scenarios & (SCENARIO_ITERATOR | SCENARIO_MATRIX))) {
+        printf("--record needs the iterator or matrix scenario\n");
+        return false;
+    }
+    if (opts->n_loops < 1 || opts->steady_window < 2 ||
+        opts->mp_procs < 2) {
+        return false;
+    }
+    if (opts->max_loops < opts->n_loops) {
+        opts->max_loops = opts->n_loops;
+    }
+    return true;
+}
+
+/*
+ *  ===================
+ *  FDB BENCH MARK TEST
+ *  ===================
+ *  Performs unit benchmarking with 16 dbfiles each with max 16 kvs
+ */
+int main(int argc, char* args[]) {
+
+    bench_opts_t opts;
+
+    if (!parse_bench_opts(&opts, argc, args)) {
+        usage(args[0]);
+        return 1;
+    }
+
+    if (opts.record_path && trace_open_writer(opts.record_path) != 0) {
+        printf("cannot create trace %s\n", opts.record_path);
+        return 1;
+    }
+
+    if (opts.scenarios & SCENARIO_ITERATOR) {
+        bench_profile_t profile = bench_profiles()[0];
+        do_bench(&opts, &profile, NULL);
+    }
+    if (opts.scenarios & SCENARIO_RECOVERY) {
+        do_recovery_bench(&opts);
+    }
+    if (opts.scenarios & SCENARIO_REPLAY) {
+        do_replay_bench(&opts);
+    }
+    if (opts.scenarios & SCENARIO_MATRIX) {
+        do_matrix_bench(&opts);
+    }
+    if (opts.scenarios & SCENARIO_BGFLUSH) {
+        do_bgflush_bench(&opts);
+    }
+    if (opts.scenarios & SCENARIO_GROUP_COMMIT) {
+        do_group_commit_bench(&opts);
+    }
+    if (opts.scenarios & SCENARIO_KVS_SCALING) {
+        do_kvs_scaling_bench(&opts);
+    }
+    if (opts.scenarios & SCENARIO_LOOKUP) {
+        do_lookup_bench(&opts);
+    }
+    if (opts.scenarios & SCENARIO_AGING) {
+        do_aging_bench(&opts);
+    }
+    if (opts.scenarios & SCENARIO_ROLLBACK) {
+        do_rollback_bench(&opts);
+    }
+    if (opts.scenarios & SCENARIO_CODEC) {
+        do_codec_bench(&opts);
+    }
+    if (opts.scenarios & SCENARIO_MULTIPROC) {
+        do_multiproc_bench(&opts);
+    }
 
-    do_bench();
+    trace_close_writer();
 }
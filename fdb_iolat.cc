@@ -0,0 +1,347 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2016 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+/*
+ *  ======================
+ *  STORAGE LATENCY SHIM
+ *  ======================
+ *  LD_PRELOAD library that makes the bench* files behave like a slow or
+ *  jittery disk. pread/pwrite/fsync/fdatasync on files whose name starts
+ *  with FDB_IOLAT_PREFIX are delayed, every other fd is passed through.
+ *
+ *    FDB_IOLAT_PREFIX        file name prefix to slow down (default bench)
+ *    FDB_IOLAT_READ_US       base latency added to every read
+ *    FDB_IOLAT_WRITE_US      base latency added to every write
+ *    FDB_IOLAT_SYNC_US       base latency added to every fsync/fdatasync
+ *    FDB_IOLAT_DIST          fixed (default), uniform or exp
+ *    FDB_IOLAT_JITTER_US     spread of the distribution for every op:
+ *                            uniform adds [0, jitter), exp adds a mean
+ *                            of jitter
+ *    FDB_IOLAT_READ_JITTER_US, FDB_IOLAT_WRITE_JITTER_US,
+ *    FDB_IOLAT_SYNC_JITTER_US  override the jitter for one kind of op
+ *    FDB_IOLAT_STALL_EVERY_MS  every N ms the device stalls ...
+ *    FDB_IOLAT_STALL_MS        ... for this long, blocking all I/O
+ *    FDB_IOLAT_MBPS          bandwidth cap shared by reads and writes
+ *
+ *  e.g. FDB_IOLAT_SYNC_US=5000 LD_PRELOAD=./libfdb_iolat.so ./fdb_bench
+ */
+
+#if defined(__linux__)
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <mutex>
+
+enum iolat_dist {
+    DIST_FIXED,
+    DIST_UNIFORM,
+    DIST_EXP
+};
+
+enum iolat_op {
+    OP_READ,
+    OP_WRITE,
+    OP_SYNC
+};
+
+static const int MAX_FDS = 65536;
+
+static struct {
+    const char *prefix;
+    uint64_t base_us[3];
+    iolat_dist dist;
+    uint64_t jitter_us[3];
+    uint64_t stall_every_ns;
+    uint64_t stall_ns;
+    double bytes_per_ns;
+} cfg;
+
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+static std::atomic<bool> tracked[MAX_FDS];
+static std::mutex bw_lock;
+static uint64_t bw_next_free;     // when the capped device is idle again
+static uint64_t start_ns;
+
+typedef int (*open_fn)(const char *, int, ...);
+typedef int (*openat_fn)(int, const char *, int, ...);
+typedef int (*close_fn)(int);
+typedef ssize_t (*pread_fn)(int, void *, size_t, off_t);
+typedef ssize_t (*pread64_fn)(int, void *, size_t, off64_t);
+typedef ssize_t (*pwrite_fn)(int, const void *, size_t, off_t);
+typedef ssize_t (*pwrite64_fn)(int, const void *, size_t, off64_t);
+typedef int (*sync_fn)(int);
+
+static open_fn real_open, real_open64;
+static openat_fn real_openat;
+static close_fn real_close;
+static pread_fn real_pread;
+static pread64_fn real_pread64;
+static pwrite_fn real_pwrite;
+static pwrite64_fn real_pwrite64;
+static sync_fn real_fsync, real_fdatasync;
+
+static uint64_t now_ns() {
+
+    struct timespec tm;
+    clock_gettime(CLOCK_MONOTONIC, &tm);
+    return tm.tv_sec * 1000000000ULL + tm.tv_nsec;
+}
+
+static void sleep_ns(uint64_t ns) {
+
+    struct timespec tm;
+    tm.tv_sec = ns / 1000000000ULL;
+    tm.tv_nsec = ns % 1000000000ULL;
+    while (nanosleep(&tm, &tm) != 0) {
+    }
+}
+
+static uint64_t env_u64(const char *name, uint64_t def) {
+
+    const char *val = getenv(name);
+    return val ? strtoull(val, NULL, 10) : def;
+}
+
+static void iolat_load() {
+
+    const char *dist;
+    uint64_t jitter;
+
+    real_open = (open_fn)dlsym(RTLD_NEXT, "open");
+    real_open64 = (open_fn)dlsym(RTLD_NEXT, "open64");
+    real_openat = (openat_fn)dlsym(RTLD_NEXT, "openat");
+    real_close = (close_fn)dlsym(RTLD_NEXT, "close");
+    real_pread = (pread_fn)dlsym(RTLD_NEXT, "pread");
+    real_pread64 = (pread64_fn)dlsym(RTLD_NEXT, "pread64");
+    real_pwrite = (pwrite_fn)dlsym(RTLD_NEXT, "pwrite");
+    real_pwrite64 = (pwrite64_fn)dlsym(RTLD_NEXT, "pwrite64");
+    real_fsync = (sync_fn)dlsym(RTLD_NEXT, "fsync");
+    real_fdatasync = (sync_fn)dlsym(RTLD_NEXT, "fdatasync");
+
+    cfg.prefix = getenv("FDB_IOLAT_PREFIX");
+    if (!cfg.prefix) {
+        cfg.prefix = "bench";
+    }
+    cfg.base_us[OP_READ] = env_u64("FDB_IOLAT_READ_US", 0);
+    cfg.base_us[OP_WRITE] = env_u64("FDB_IOLAT_WRITE_US", 0);
+    cfg.base_us[OP_SYNC] = env_u64("FDB_IOLAT_SYNC_US", 0);
+    jitter = env_u64("FDB_IOLAT_JITTER_US", 0);
+    cfg.jitter_us[OP_READ] = env_u64("FDB_IOLAT_READ_JITTER_US", jitter);
+    cfg.jitter_us[OP_WRITE] = env_u64("FDB_IOLAT_WRITE_JITTER_US", jitter);
+    cfg.jitter_us[OP_SYNC] = env_u64("FDB_IOLAT_SYNC_JITTER_US", jitter);
+    cfg.stall_every_ns = env_u64("FDB_IOLAT_STALL_EVERY_MS", 0) * 1000000;
+    cfg.stall_ns = env_u64("FDB_IOLAT_STALL_MS", 0) * 1000000;
+    cfg.bytes_per_ns = env_u64("FDB_IOLAT_MBPS", 0) * 1024.0 * 1024.0 / 1e9;
+
+    dist = getenv("FDB_IOLAT_DIST");
+    cfg.dist = DIST_FIXED;
+    if (dist && !strcmp(dist, "uniform")) {
+        cfg.dist = DIST_UNIFORM;
+    } else if (dist && !strcmp(dist, "exp")) {
+        cfg.dist = DIST_EXP;
+    }
+
+    start_ns = now_ns();
+}
+
+static void iolat_init() {
+    pthread_once(&init_once, iolat_load);
+}
+
+static void track_fd(int fd, const char *path) {
+
+    const char *base;
+
+    if (fd < 0 || fd >= MAX_FDS) {
+        return;
+    }
+    base = strrchr(path, '/');
+    base = base ? base + 1 : path;
+    tracked[fd] = !strncmp(base, cfg.prefix, strlen(cfg.prefix));
+}
+
+// per-thread xorshift, uniform in [0, 1)
+static double rand_unit() {
+
+    static __thread uint64_t state;
+    if (!state) {
+        state = now_ns() ^ (uint64_t)(uintptr_t)&state;
+    }
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return (state >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// block the calling thread as the configured device would
+static void inject(int fd, iolat_op op, size_t bytes) {
+
+    uint64_t delay_ns, now;
+
+    if (fd < 0 || fd >= MAX_FDS || !tracked[fd]) {
+        return;
+    }
+
+    delay_ns = cfg.base_us[op] * 1000;
+    if (cfg.jitter_us[op]) {
+        if (cfg.dist == DIST_UNIFORM) {
+            delay_ns += rand_unit() * cfg.jitter_us[op] * 1000;
+        } else if (cfg.dist == DIST_EXP) {
+            delay_ns += -log(1.0 - rand_unit()) * cfg.jitter_us[op] * 1000;
+        }
+    }
+
+    // bandwidth cap: requests queue behind each other on one device
+    if (cfg.bytes_per_ns > 0 && bytes > 0) {
+        uint64_t busy = bytes / cfg.bytes_per_ns;
+        std::lock_guard<std::mutex> lh(bw_lock);
+        now = now_ns();
+        bw_next_free = std::max(bw_next_free, now) + busy;
+        delay_ns = std::max(delay_ns, bw_next_free - now);
+    }
+
+    if (delay_ns) {
+        sleep_ns(delay_ns);
+    }
+
+    // periodic stall: wait out the rest of the current stall window
+    if (cfg.stall_every_ns && cfg.stall_ns) {
+        now = now_ns();
+        uint64_t phase = (now - start_ns) % cfg.stall_every_ns;
+        if (phase < cfg.stall_ns) {
+            sleep_ns(cfg.stall_ns - phase);
+        }
+    }
+}
+
+extern "C" {
+
+int open(const char *path, int flags, ...) {
+
+    mode_t mode = 0;
+    iolat_init();
+    if (flags & O_CREAT) {
+        va_list ap;
+        va_start(ap, flags);
+        mode = va_arg(ap, int);
+        va_end(ap);
+    }
+    int fd = real_open(path, flags, mode);
+    track_fd(fd, path);
+    return fd;
+}
+
+int open64(const char *path, int flags, ...) {
+
+    mode_t mode = 0;
+    iolat_init();
+    if (flags & O_CREAT) {
+        va_list ap;
+        va_start(ap, flags);
+        mode = va_arg(ap, int);
+        va_end(ap);
+    }
+    int fd = (real_open64 ? real_open64 : real_open)(path, flags, mode);
+    track_fd(fd, path);
+    return fd;
+}
+
+int openat(int dirfd, const char *path, int flags, ...) {
+
+    mode_t mode = 0;
+    iolat_init();
+    if (flags & O_CREAT) {
+        va_list ap;
+        va_start(ap, flags);
+        mode = va_arg(ap, int);
+        va_end(ap);
+    }
+    int fd = real_openat(dirfd, path, flags, mode);
+    track_fd(fd, path);
+    return fd;
+}
+
+int close(int fd) {
+
+    iolat_init();
+    if (fd >= 0 && fd < MAX_FDS) {
+        tracked[fd] = false;
+    }
+    return real_close(fd);
+}
+
+ssize_t pread(int fd, void *buf, size_t count, off_t offset) {
+
+    iolat_init();
+    inject(fd, OP_READ, count);
+    return real_pread(fd, buf, count, offset);
+}
+
+ssize_t pread64(int fd, void *buf, size_t count, off64_t offset) {
+
+    iolat_init();
+    inject(fd, OP_READ, count);
+    return real_pread64(fd, buf, count, offset);
+}
+
+ssize_t pwrite(int fd, const void *buf, size_t count, off_t offset) {
+
+    iolat_init();
+    inject(fd, OP_WRITE, count);
+    return real_pwrite(fd, buf, count, offset);
+}
+
+ssize_t pwrite64(int fd, const void *buf, size_t count, off64_t offset) {
+
+    iolat_init();
+    inject(fd, OP_WRITE, count);
+    return real_pwrite64(fd, buf, count, offset);
+}
+
+int fsync(int fd) {
+
+    iolat_init();
+    inject(fd, OP_SYNC, 0);
+    return real_fsync(fd);
+}
+
+int fdatasync(int fd) {
+
+    iolat_init();
+    inject(fd, OP_SYNC, 0);
+    return real_fdatasync(fd);
+}
+
+} // extern "C"
+
+#endif // __linux__
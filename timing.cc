@@ -110,6 +110,70 @@ ts_nsec timed_fdb_get(fdb_kvs_handle *kv, fdb_doc *doc) {
     }
 }
 
+ts_nsec timed_fdb_get_metaonly(fdb_kvs_handle *kv, fdb_doc *doc) {
+
+    ts_nsec start, end;
+    fdb_status status;
+
+    start = get_monotonic_ts();
+    status = fdb_get_metaonly(kv, doc);
+    end = get_monotonic_ts();
+
+    if (status == FDB_RESULT_SUCCESS) {
+        return ts_diff(start, end);
+    } else {
+        return ERR_NS;
+    }
+}
+
+ts_nsec timed_fdb_get_metaonly_byseq(fdb_kvs_handle *kv, fdb_doc *doc) {
+
+    ts_nsec start, end;
+    fdb_status status;
+
+    start = get_monotonic_ts();
+    status = fdb_get_metaonly_byseq(kv, doc);
+    end = get_monotonic_ts();
+
+    if (status == FDB_RESULT_SUCCESS) {
+        return ts_diff(start, end);
+    } else {
+        return ERR_NS;
+    }
+}
+
+ts_nsec timed_fdb_get_byseq(fdb_kvs_handle *kv, fdb_doc *doc) {
+
+    ts_nsec start, end;
+    fdb_status status;
+
+    start = get_monotonic_ts();
+    status = fdb_get_byseq(kv, doc);
+    end = get_monotonic_ts();
+
+    if (status == FDB_RESULT_SUCCESS) {
+        return ts_diff(start, end);
+    } else {
+        return ERR_NS;
+    }
+}
+
+ts_nsec timed_fdb_get_byoffset(fdb_kvs_handle *kv, fdb_doc *doc) {
+
+    ts_nsec start, end;
+    fdb_status status;
+
+    start = get_monotonic_ts();
+    status = fdb_get_byoffset(kv, doc);
+    end = get_monotonic_ts();
+
+    if (status == FDB_RESULT_SUCCESS) {
+        return ts_diff(start, end);
+    } else {
+        return ERR_NS;
+    }
+}
+
 ts_nsec timed_fdb_delete(fdb_kvs_handle *kv, fdb_doc *doc) {
 
     ts_nsec start, end;
@@ -143,6 +207,77 @@ ts_nsec timed_fdb_snapshot(fdb_kvs_handle *kv, fdb_kvs_handle **snap_kv) {
 
 }
 
+ts_nsec timed_fdb_rollback(fdb_kvs_handle **kv, fdb_seqnum_t seqnum) {
+
+    ts_nsec start, end;
+    fdb_status status;
+
+    start = get_monotonic_ts();
+    status = fdb_rollback(kv, seqnum);
+    end = get_monotonic_ts();
+
+    if (status == FDB_RESULT_SUCCESS) {
+        return ts_diff(start, end);
+    } else {
+        return ERR_NS;
+    }
+
+}
+
+ts_nsec timed_fdb_changes_since(fdb_kvs_handle *kv, fdb_seqnum_t since,
+                                fdb_changes_callback_fn callback, void *ctx) {
+
+    ts_nsec start, end;
+    fdb_status status;
+
+    start = get_monotonic_ts();
+    status = fdb_changes_since(kv, since, FDB_ITR_NONE, callback, ctx);
+    end = get_monotonic_ts();
+
+    if (status == FDB_RESULT_SUCCESS) {
+        return ts_diff(start, end);
+    } else {
+        return ERR_NS;
+    }
+
+}
+
+ts_nsec timed_fdb_open(fdb_file_handle **fhandle, const char *fname,
+                       fdb_config *fconfig) {
+
+    ts_nsec start, end;
+    fdb_status status;
+
+    start = get_monotonic_ts();
+    status = fdb_open(fhandle, fname, fconfig);
+    end = get_monotonic_ts();
+
+    if (status == FDB_RESULT_SUCCESS) {
+        return ts_diff(start, end);
+    } else {
+        return ERR_NS;
+    }
+
+}
+
+ts_nsec timed_fdb_kvs_open(fdb_file_handle *fhandle, fdb_kvs_handle **kv,
+                           const char *name, fdb_kvs_config *kvs_config) {
+
+    ts_nsec start, end;
+    fdb_status status;
+
+    start = get_monotonic_ts();
+    status = fdb_kvs_open(fhandle, kv, name, kvs_config);
+    end = get_monotonic_ts();
+
+    if (status == FDB_RESULT_SUCCESS) {
+        return ts_diff(start, end);
+    } else {
+        return ERR_NS;
+    }
+
+}
+
 ts_nsec timed_fdb_kvs_close(fdb_kvs_handle *kv) {
 
     ts_nsec start, end;
@@ -265,7 +400,7 @@ ts_nsec timed_fdb_iterator_close(fdb_iterator *it) {
 }
 
 /*
-   return a monotonically increasing value with a seconds frequency.
+   return a monotonically increasing value in nanoseconds.
    */
 ts_nsec get_monotonic_ts() {
 
@@ -288,7 +423,7 @@ ts_nsec get_monotonic_ts() {
     if (clock_gettime(CLOCK_MONOTONIC, &tm) == -1) {
         abort();
     }
-    ts = tm.tv_nsec;
+    ts = tm.tv_sec * 1000000000L + tm.tv_nsec;
 #else
 #error "Don't know how to build get_monotonic_ts"
 #endif
@@ -296,6 +431,34 @@ ts_nsec get_monotonic_ts() {
     return ts;
 }
 
+/*
+   return cpu time consumed by all threads of the process in nanoseconds,
+   including forestdb's background threads.
+   */
+ts_nsec get_cpu_ts() {
+
+    ts_nsec ts = 0;
+#if defined(WIN32)
+    FILETIME create, exit, kernel, user;
+    if (GetProcessTimes(GetCurrentProcess(), &create, &exit, &kernel, &user)) {
+        ULARGE_INTEGER k, u;
+        k.LowPart = kernel.dwLowDateTime;
+        k.HighPart = kernel.dwHighDateTime;
+        u.LowPart = user.dwLowDateTime;
+        u.HighPart = user.dwHighDateTime;
+        ts = (k.QuadPart + u.QuadPart) * 100;
+    }
+#else
+    struct timespec tm;
+    if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &tm) == -1) {
+        abort();
+    }
+    ts = tm.tv_sec * 1000000000L + tm.tv_nsec;
+#endif
+
+    return ts;
+}
+
 ts_nsec ts_diff(ts_nsec start, ts_nsec end) {
 
     ts_nsec diff = 0;
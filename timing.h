@@ -33,17 +33,29 @@ extern "C" {
 static const long int ERR_NS = 0xFFFFFFFF;
 typedef  long int ts_nsec;
 ts_nsec get_monotonic_ts();
+ts_nsec get_cpu_ts();
 ts_nsec ts_diff(ts_nsec start, ts_nsec end);
 ts_nsec timed_fdb_get(fdb_kvs_handle *kv, fdb_doc *doc);
+ts_nsec timed_fdb_get_metaonly(fdb_kvs_handle *kv, fdb_doc *doc);
+ts_nsec timed_fdb_get_metaonly_byseq(fdb_kvs_handle *kv, fdb_doc *doc);
+ts_nsec timed_fdb_get_byseq(fdb_kvs_handle *kv, fdb_doc *doc);
+ts_nsec timed_fdb_get_byoffset(fdb_kvs_handle *kv, fdb_doc *doc);
 ts_nsec timed_fdb_set(fdb_kvs_handle *kv, fdb_doc *doc);
 ts_nsec timed_fdb_delete(fdb_kvs_handle *kv, fdb_doc *doc);
 ts_nsec timed_fdb_compact(fdb_file_handle *fhandle);
 ts_nsec timed_fdb_commit(fdb_file_handle *fhandle, bool walflush);
 ts_nsec timed_fdb_snapshot(fdb_kvs_handle *kv, fdb_kvs_handle **snap_kv);
+ts_nsec timed_fdb_rollback(fdb_kvs_handle **kv, fdb_seqnum_t seqnum);
+ts_nsec timed_fdb_changes_since(fdb_kvs_handle *kv, fdb_seqnum_t since,
+                                fdb_changes_callback_fn callback, void *ctx);
 ts_nsec timed_fdb_iterator_init(fdb_kvs_handle *kv, fdb_iterator **it, fdb_iterator_opt_t opt);
 ts_nsec timed_fdb_iterator_get(fdb_iterator *it, fdb_doc **doc);
 ts_nsec timed_fdb_iterator_next(fdb_iterator *it);
 ts_nsec timed_fdb_iterator_close(fdb_iterator *it);
+ts_nsec timed_fdb_open(fdb_file_handle **fhandle, const char *fname,
+                       fdb_config *fconfig);
+ts_nsec timed_fdb_kvs_open(fdb_file_handle *fhandle, fdb_kvs_handle **kv,
+                           const char *name, fdb_kvs_config *kvs_config);
 ts_nsec timed_fdb_kvs_close(fdb_kvs_handle *kv);
 ts_nsec timed_fdb_close(fdb_file_handle *fhandle);
 ts_nsec timed_fdb_shutdown();
@@ -0,0 +1,211 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2016 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#if !defined(WIN32) && !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <map>
+
+#include "libforestdb/forestdb.h"
+#include "config.h"
+#include "timing.h"
+#include "trace.h"
+
+static const size_t TRACE_WRITE_BUFFER = 4 * 1024 * 1024;
+
+static FILE *trace_fp = NULL;
+static char *trace_buf = NULL;
+static ts_nsec trace_start;
+static std::map<const void*, uint16_t> trace_ids;
+
+static size_t trace_padded(size_t key_len) {
+    return (key_len + 7) & ~(size_t)7;
+}
+
+/* recorder */
+
+int trace_open_writer(const char *path) {
+
+    trace_hdr_t hdr;
+
+    trace_fp = fopen(path, "wb");
+    if (!trace_fp) {
+        return -1;
+    }
+    trace_buf = (char*)malloc(TRACE_WRITE_BUFFER);
+    setvbuf(trace_fp, trace_buf, _IOFBF, TRACE_WRITE_BUFFER);
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, TRACE_MAGIC, sizeof(hdr.magic));
+    hdr.version = TRACE_VERSION;
+    fwrite(&hdr, sizeof(hdr), 1, trace_fp);
+
+    trace_start = get_monotonic_ts();
+    return 0;
+}
+
+void trace_close_writer() {
+
+    if (!trace_fp) {
+        return;
+    }
+    fclose(trace_fp);
+    free(trace_buf);
+    trace_fp = NULL;
+    trace_buf = NULL;
+    trace_ids.clear();
+}
+
+/*
+   map a kvs (or snapshot) handle, or a file handle, to the kvs id its
+   ops are recorded under.
+   */
+void trace_register(const void *handle, uint16_t kvs_id) {
+
+    if (trace_fp) {
+        trace_ids[handle] = kvs_id;
+    }
+}
+
+static void trace_write(uint8_t op, const void *handle, const void *key,
+                        size_t key_len, uint32_t value_size) {
+
+    static const char zeros[8] = {0};
+    trace_rec_t rec;
+
+    auto it = trace_ids.find(handle);
+    if (it == trace_ids.end()) {
+        return;
+    }
+
+    memset(&rec, 0, sizeof(rec));
+    rec.ts = get_monotonic_ts() - trace_start;
+    rec.value_size = value_size;
+    rec.kvs_id = it->second;
+    rec.key_len = key_len;
+    rec.op = op;
+
+    fwrite(&rec, sizeof(rec), 1, trace_fp);
+    if (key_len) {
+        fwrite(key, key_len, 1, trace_fp);
+        fwrite(zeros, trace_padded(key_len) - key_len, 1, trace_fp);
+    }
+}
+
+void trace_record_doc(uint8_t op, fdb_kvs_handle *kv, fdb_doc *doc) {
+
+    if (trace_fp) {
+        trace_write(op, kv, doc->key, doc->keylen, doc->bodylen);
+    }
+}
+
+void trace_record_commit(fdb_file_handle *fhandle, bool walflush) {
+
+    if (trace_fp) {
+        trace_write(TRACE_OP_COMMIT, fhandle, NULL, 0, walflush ? 1 : 0);
+    }
+}
+
+/* replayer */
+
+int trace_open_reader(trace_reader_t *reader, const char *path) {
+
+#if !defined(WIN32) && !defined(_WIN32)
+    struct stat st;
+    const trace_hdr_t *hdr;
+
+    reader->fd = open(path, O_RDONLY);
+    if (reader->fd < 0) {
+        return -1;
+    }
+    if (fstat(reader->fd, &st) != 0 || (size_t)st.st_size < sizeof(*hdr)) {
+        close(reader->fd);
+        return -1;
+    }
+
+    reader->len = st.st_size;
+    reader->base = (const char*)mmap(NULL, reader->len, PROT_READ,
+                                     MAP_SHARED, reader->fd, 0);
+    if (reader->base == MAP_FAILED) {
+        close(reader->fd);
+        return -1;
+    }
+    madvise((void*)reader->base, reader->len, MADV_SEQUENTIAL);
+
+    hdr = (const trace_hdr_t*)reader->base;
+    if (memcmp(hdr->magic, TRACE_MAGIC, sizeof(hdr->magic)) ||
+        hdr->version != TRACE_VERSION) {
+        trace_close_reader(reader);
+        return -1;
+    }
+    return 0;
+#else
+    (void)reader;
+    (void)path;
+    return -1;
+#endif
+}
+
+/*
+   return the record at *pos (0 for the first one) and advance *pos,
+   or NULL once the trace is exhausted or truncated.
+   */
+const trace_rec_t *trace_next(const trace_reader_t *reader, size_t *pos,
+                              const char **key) {
+
+    const trace_rec_t *rec;
+
+    if (*pos < sizeof(trace_hdr_t)) {
+        *pos = sizeof(trace_hdr_t);
+    }
+    if (*pos + sizeof(trace_rec_t) > reader->len) {
+        return NULL;
+    }
+
+    do {
+        if (*pos + sizeof(trace_rec_t) > reader->len) {
+            return NULL;
+        }
+        rec = (const trace_rec_t*)(reader->base + *pos);
+        if (*pos + sizeof(trace_rec_t) + rec->key_len > reader->len) {
+            return NULL;
+        }
+        *key = reader->base + *pos + sizeof(trace_rec_t);
+        *pos += sizeof(trace_rec_t) + trace_padded(rec->key_len);
+        // unknown ops (corrupt or foreign traces) are skipped, callers
+        // index per-op tables with rec->op
+    } while (rec->op >= TRACE_NUM_OPS);
+    return rec;
+}
+
+void trace_close_reader(trace_reader_t *reader) {
+
+#if !defined(WIN32) && !defined(_WIN32)
+    munmap((void*)reader->base, reader->len);
+    close(reader->fd);
+#endif
+    reader->base = NULL;
+    reader->len = 0;
+}
@@ -0,0 +1,84 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2016 Couchbase, Inc
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Binary trace format
+ *
+ *   trace_hdr_t, then one trace_rec_t per op followed by key_len key
+ *   bytes padded up to a multiple of 8 so every record stays aligned
+ *   when the file is memory-mapped.
+ *
+ * A commit record's kvs_id names any kvs of the committed file and its
+ * value_size holds 1 for a manual WAL flush commit, 0 otherwise.
+ */
+static const char TRACE_MAGIC[8] = {'F', 'D', 'B', 'T', 'R', 'A', 'C', 'E'};
+static const uint32_t TRACE_VERSION = 1;
+
+enum {
+    TRACE_OP_SET = 0,
+    TRACE_OP_GET = 1,
+    TRACE_OP_DEL = 2,
+    TRACE_OP_COMMIT = 3,
+    TRACE_NUM_OPS = 4
+};
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+} trace_hdr_t;
+
+typedef struct {
+    uint64_t ts;            // ns since the recorder was opened
+    uint32_t value_size;
+    uint16_t kvs_id;
+    uint16_t key_len;
+    uint8_t op;
+    uint8_t pad[7];
+} trace_rec_t;
+
+typedef struct {
+    const char *base;       // mapped trace file
+    size_t len;
+    int fd;
+} trace_reader_t;
+
+// recorder, not thread safe; every call is a no-op unless it is open
+int trace_open_writer(const char *path);
+void trace_close_writer();
+void trace_register(const void *handle, uint16_t kvs_id);
+void trace_record_doc(uint8_t op, fdb_kvs_handle *kv, fdb_doc *doc);
+void trace_record_commit(fdb_file_handle *fhandle, bool walflush);
+
+// replayer, any number of threads may walk one reader with own cursors;
+// trace_next() never returns a record with op >= TRACE_NUM_OPS
+int trace_open_reader(trace_reader_t *reader, const char *path);
+const trace_rec_t *trace_next(const trace_reader_t *reader, size_t *pos,
+                              const char **key);
+void trace_close_reader(trace_reader_t *reader);
+
+#ifdef __cplusplus
+}
+#endif